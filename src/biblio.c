@@ -37,6 +37,7 @@
 #include "latex.h"
 #include "environment.h"
 
+extern Gummi* gummi;
 extern GuEditor* ec;
 
 GuBiblio* biblio_init(GtkBuilder* builder)
@@ -91,38 +92,26 @@ gboolean biblio_detect_bibliography(GuBiblio* bc, GuEditor* ec)
   return state;
 }
 
-gboolean biblio_compile_bibliography(GuBiblio* bc, GuEditor* ec, GuLatex* lc)
+gboolean biblio_compile_bibliography(GuBiblio* bc, GuAuxtoolsFunc done,
+                                     gpointer user)
 {
-  gchar* dirname = g_path_get_dirname(ec->workfile);
-  gchar* auxname = NULL;
-
-  if (ec->filename) {
-    auxname = g_strdup(ec->pdffile);
-    auxname[strlen(auxname) - 4] = 0;
-  } else
-    auxname = g_strdup(ec->fdname);
-
-  if (g_find_program_in_path("bibtex")) {
-    gboolean success = FALSE;
-    char* command = g_strdup_printf("%s bibtex \"%s\"",
-                                    C_TEXSEC, auxname);
-
-    g_free(auxname);
-    latex_update_workfile(lc, ec);
-    latex_update_auxfile(lc, ec);
-    Tuple2 res = utils_popen_r(command, dirname);
-    gtk_widget_set_tooltip_text(GTK_WIDGET(bc->progressbar),
-                                (gchar*)res.second);
-    g_free(command);
-    g_free(dirname);
-    success = !(strstr((gchar*)res.second, "Database file #1") == NULL);
-    g_free(res.second);
-    return success;
+  gchar* bibtex = NULL;
+
+  if (!(bibtex = g_find_program_in_path("bibtex"))) {
+    slog(L_WARNING, "bibtex command is not present or executable.\n");
+    return FALSE;
   }
-  slog(L_WARNING, "bibtex command is not present or executable.\n");
-  g_free(auxname);
-  g_free(dirname);
-  return FALSE;
+  g_free(bibtex);
+
+  motion_run_auxtools(gummi->motion, AUX_BIBTEX, done, user);
+  return TRUE;
+}
+
+gboolean biblio_bibliography_compiled(GuBiblio* bc, guint ran,
+                                      const gchar* output)
+{
+  gtk_widget_set_tooltip_text(GTK_WIDGET(bc->progressbar), output);
+  return (ran & AUX_BIBTEX) && strstr(output, "Database file #1") != NULL;
 }
 
 int biblio_parse_entries(GuBiblio* bc, gchar *bib_content)
@@ -33,6 +33,7 @@
 #include <gtk/gtk.h>
 
 #include "latex.h"
+#include "motion.h"
 
 #define GU_BIBLIO(x) ((GuBiblio*)x)
 typedef struct _GuBiblio GuBiblio;
@@ -50,7 +51,27 @@ struct _GuBiblio {
 
 GuBiblio* biblio_init(GtkBuilder* builder);
 gboolean biblio_detect_bibliography(GuBiblio* bc, GuEditor* ec);
-gboolean biblio_compile_bibliography(GuBiblio* bc, GuEditor* ec, GuLatex* lc);
+
+/**
+ * biblio_compile_bibliography:
+ *
+ * Queues a bibtex run for the active document on the compile thread, done
+ * is called from the main loop once it finished.
+ *
+ * Returns: FALSE if bibtex is not installed and done won't be called.
+ */
+gboolean biblio_compile_bibliography(GuBiblio* bc, GuAuxtoolsFunc done,
+                                     gpointer user);
+
+/**
+ * biblio_bibliography_compiled:
+ *
+ * Shows the output of the bibtex run reported to done.
+ *
+ * Returns: TRUE if bibtex read a database successfully.
+ */
+gboolean biblio_bibliography_compiled(GuBiblio* bc, guint ran,
+                                      const gchar* output);
 int biblio_parse_entries(GuBiblio* bc, gchar *bib_content);
 
 
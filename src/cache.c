@@ -0,0 +1,213 @@
+/**
+ * @file   cache.c
+ * @brief  size bounded on-disk cache
+ *
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "cache.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "utils.h"
+
+typedef struct {
+  gchar* path;
+  goffset size;
+  time_t mtime;
+} CacheEntry;
+
+static goffset cache_entry_size(const gchar* path);
+static void cache_remove_entry(const gchar* path);
+static gint cache_entry_compare(gconstpointer a, gconstpointer b);
+
+GuCache* cache_init(const gchar* dir)
+{
+  GuCache* c = g_new0(GuCache, 1);
+
+  c->dir = g_strdup(dir);
+  c->hits = 0;
+  c->misses = 0;
+  g_mkdir_with_parents(c->dir, DIR_PERMS);
+
+  return c;
+}
+
+gchar* cache_get_key(const gchar* first, ...)
+{
+  GChecksum* checksum = g_checksum_new(G_CHECKSUM_MD5);
+  const gchar* str = first;
+  gchar* key = NULL;
+  va_list vap;
+
+  va_start(vap, first);
+  while (str) {
+    g_checksum_update(checksum, (guchar*)str, -1);
+    /* separator, so ("ab", "c") and ("a", "bc") don't collide */
+    g_checksum_update(checksum, (guchar*)"", 1);
+    str = va_arg(vap, const gchar*);
+  }
+  va_end(vap);
+
+  key = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+  return key;
+}
+
+gchar* cache_lookup(GuCache* cache, const gchar* key)
+{
+  gchar* path = g_build_filename(cache->dir, key, NULL);
+
+  if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
+    cache->misses++;
+    g_free(path);
+    return NULL;
+  }
+
+  /* The modification time of the entry is its LRU stamp */
+  g_utime(path, NULL);
+  cache->hits++;
+  return path;
+}
+
+gboolean cache_store_file(GuCache* cache, const gchar* key,
+                          const gchar* name, const gchar* source)
+{
+  GError* err = NULL;
+  gchar* path = g_build_filename(cache->dir, key, NULL);
+  gchar* dest = g_build_filename(path, name, NULL);
+  gboolean ret = FALSE;
+
+  g_mkdir_with_parents(path, DIR_PERMS);
+  if (!(ret = utils_copy_file(source, dest, &err))) {
+    slog(L_ERROR, "Could not store %s in cache: %s\n", name, err->message);
+    g_error_free(err);
+  }
+  g_free(dest);
+  g_free(path);
+  return ret;
+}
+
+gboolean cache_store_contents(GuCache* cache, const gchar* key,
+                              const gchar* name, const gchar* text)
+{
+  gchar* path = g_build_filename(cache->dir, key, NULL);
+  gchar* dest = g_build_filename(path, name, NULL);
+  gboolean ret = FALSE;
+
+  g_mkdir_with_parents(path, DIR_PERMS);
+  ret = utils_set_file_contents(dest, text ? text : "", -1);
+  g_free(dest);
+  g_free(path);
+  return ret;
+}
+
+void cache_evict(GuCache* cache, goffset max_size)
+{
+  GDir* dir = NULL;
+  const gchar* name = NULL;
+  GSList* entries = NULL;
+  GSList* iter = NULL;
+  goffset total = 0;
+  GStatBuf st;
+
+  if (!(dir = g_dir_open(cache->dir, 0, NULL))) return;
+
+  while ((name = g_dir_read_name(dir))) {
+    gchar* path = g_build_filename(cache->dir, name, NULL);
+    if (g_stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+      CacheEntry* entry = g_new0(CacheEntry, 1);
+      entry->path = path;
+      entry->size = cache_entry_size(path);
+      entry->mtime = st.st_mtime;
+      total += entry->size;
+      entries = g_slist_prepend(entries, entry);
+    } else {
+      g_free(path);
+    }
+  }
+  g_dir_close(dir);
+
+  entries = g_slist_sort(entries, cache_entry_compare);
+  for (iter = entries; iter; iter = iter->next) {
+    CacheEntry* entry = (CacheEntry*)iter->data;
+    if (total > max_size) {
+      slog(L_DEBUG, "Evicting cache entry %s\n", entry->path);
+      cache_remove_entry(entry->path);
+      total -= entry->size;
+    }
+    g_free(entry->path);
+    g_free(entry);
+  }
+  g_slist_free(entries);
+}
+
+static goffset cache_entry_size(const gchar* path)
+{
+  GDir* dir = NULL;
+  const gchar* name = NULL;
+  goffset size = 0;
+  GStatBuf st;
+
+  if (!(dir = g_dir_open(path, 0, NULL))) return 0;
+  while ((name = g_dir_read_name(dir))) {
+    gchar* file = g_build_filename(path, name, NULL);
+    if (g_stat(file, &st) == 0)
+      size += st.st_size;
+    g_free(file);
+  }
+  g_dir_close(dir);
+  return size;
+}
+
+static void cache_remove_entry(const gchar* path)
+{
+  GDir* dir = NULL;
+  const gchar* name = NULL;
+
+  if ((dir = g_dir_open(path, 0, NULL))) {
+    while ((name = g_dir_read_name(dir))) {
+      gchar* file = g_build_filename(path, name, NULL);
+      g_remove(file);
+      g_free(file);
+    }
+    g_dir_close(dir);
+  }
+  g_rmdir(path);
+}
+
+static gint cache_entry_compare(gconstpointer a, gconstpointer b)
+{
+  const CacheEntry* ea = (const CacheEntry*)a;
+  const CacheEntry* eb = (const CacheEntry*)b;
+
+  if (ea->mtime < eb->mtime) return -1;
+  return (ea->mtime > eb->mtime);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file   cache.h
+ * @brief  size bounded on-disk cache
+ *
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GUMMI_CACHE_H__
+#define __GUMMI_CACHE_H__
+
+#include <glib.h>
+
+/**
+ * GuCache:
+ * @dir: the directory holding the cache entries
+ * @hits: number of successful lookups
+ * @misses: number of failed lookups
+ *
+ * A content addressed cache on disk. Every entry is a directory named after
+ * its key holding one or more files. Entries that have not been used for
+ * the longest time are evicted first.
+ */
+#define GU_CACHE(x) ((GuCache*)x)
+typedef struct _GuCache GuCache;
+
+struct _GuCache {
+  gchar* dir;
+  guint hits;
+  guint misses;
+};
+
+GuCache* cache_init(const gchar* dir);
+
+/**
+ * cache_get_key:
+ *
+ * Returns: A newly allocated hex digest over all strings of the NULL
+ * terminated argument list.
+ */
+gchar* cache_get_key(const gchar* first, ...) G_GNUC_NULL_TERMINATED;
+
+/**
+ * cache_lookup:
+ *
+ * Returns: A newly allocated path to the entry directory of key or NULL if
+ * the entry does not exist. The entry is marked as most recently used.
+ */
+gchar* cache_lookup(GuCache* cache, const gchar* key);
+gboolean cache_store_file(GuCache* cache, const gchar* key,
+                          const gchar* name, const gchar* source);
+gboolean cache_store_contents(GuCache* cache, const gchar* key,
+                              const gchar* name, const gchar* text);
+
+/**
+ * cache_evict:
+ *
+ * Removes the least recently used entries until the total size of the
+ * cache is below max_size bytes.
+ */
+void cache_evict(GuCache* cache, goffset max_size);
+
+#endif /* __GUMMI_CACHE_H__ */
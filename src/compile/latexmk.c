@@ -38,11 +38,13 @@ gboolean lmk_detected = FALSE;
 
 void latexmk_init(void)
 {
+  gchar* version = NULL;
 
   if (external_exists(C_LATEXMK)) {
     // TODO: check if supported version
-    slog(L_INFO, "Typesetter detected: Latexmk %s\n",
-         external_version(C_LATEXMK));
+    if ((version = external_version(C_LATEXMK)))
+      slog(L_INFO, "Typesetter detected: Latexmk %s\n", version);
+    g_free(version);
     lmk_detected = TRUE;
   }
 }
@@ -38,11 +38,13 @@ gboolean rub_detected = FALSE;
 
 void rubber_init(void)
 {
+  gchar* version = NULL;
 
   if (external_exists(C_RUBBER)) {
     // TODO: check if supported version
-    slog(L_INFO, "Typesetter detected: Rubber %s\n",
-         external_version(C_RUBBER));
+    if ((version = external_version(C_RUBBER)))
+      slog(L_INFO, "Typesetter detected: Rubber %s\n", version);
+    g_free(version);
     rub_detected = TRUE;
   }
 }
@@ -29,10 +29,21 @@
 
 #include "texlive.h"
 
+#include <string.h>
+#include <unistd.h>
+
+#ifndef WIN32
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include "configfile.h"
 #include "constants.h"
+#include "deptracker.h"
 #include "latex.h"
 #include "utils.h"
 #include "external.h"
@@ -40,26 +51,75 @@
 gboolean pdf_detected = FALSE;
 gboolean xel_detected = FALSE;
 
+/* preamble formats kept at once, each one takes tens of megabytes */
+#define FMT_CACHE_SIZE 4
+
+/* seconds before a preamble whose dump failed is dumped again */
+#define FMT_RETRY_DELAY 60
+
+/* A dumped preamble format. path is NULL if dumping it failed at the
+ * monotonic time failed, deps are the local files the preamble loaded and
+ * stamp their sizes and mtimes at the time of the dump */
+typedef struct {
+  gchar* path;
+  GSList* deps;
+  gchar* stamp;
+  gint64 used;
+  gint64 failed;
+} TexliveFormat;
+
+/* Preamble format cache keyed by the preamble hash, only touched from the
+ * compile thread */
+static gint mlf_detected = -1;
+static GHashTable* formats = NULL;
+
+/* Warm typesetter that is parked before reading the document, only
+ * touched from the compile thread */
+static GPid warm_pid = 0;
+static gint warm_in = -1;
+static gint warm_out = -1;
+static gchar* warm_cmd = NULL;
+static gchar* warm_dir = NULL;
+static gboolean draft_pass = FALSE;
+
+extern pid_t typesetter_pid;
+
+static gchar* texlive_get_format(const gchar* typesetter, gchar* workfile,
+                                 const gchar* chdir);
+static gchar* texlive_get_texpdf_command(const gchar* typesetter,
+                                         const gchar* flags,
+                                         const gchar* outdir,
+                                         gchar* workfile,
+                                         const gchar* input,
+                                         const gchar* chdir);
+
 /* All the functions for "pure" building with texlive only tools */
 
 int texlive_init(void)
 {
   int texversion = 0;
+  gchar* version = NULL;
 
+  /* versions that are not cached yet are logged once they are probed */
   if (external_exists(C_LATEX)) {
-    texversion = external_version2(EX_TEXLIVE);
-    slog(L_INFO, "Texlive %d was found installed..\n", texversion);
+    gdouble found = external_version2(EX_TEXLIVE);
+    if (found >= 0) {
+      texversion = found;
+      slog(L_INFO, "Texlive %d was found installed..\n", texversion);
+    }
   }
 
   if (external_exists(C_PDFLATEX)) {
-    slog(L_INFO, "Typesetter detected: %s\n",
-         external_version(C_PDFLATEX));
+    if ((version = external_version(C_PDFLATEX)))
+      slog(L_INFO, "Typesetter detected: %s\n", version);
+    g_free(version);
     pdf_detected = TRUE;
   }
 
   if (external_exists(C_XELATEX)) {
-    slog(L_INFO, "Typesetter detected: %s\n",
-         external_version(C_XELATEX));
+    if ((version = external_version(C_XELATEX)))
+      slog(L_INFO, "Typesetter detected: %s\n", version);
+    g_free(version);
     xel_detected = TRUE;
   }
   return texversion;
@@ -124,11 +184,12 @@ gchar* texlive_get_command(const gchar* method, gchar* workfile,
 #endif
 
   if (STR_EQU(method, "texpdf")) {
-
-    texcmd = g_strdup_printf("%s %s %s \"%s\"", typesetter,
-                             flags,
-                             outdir,
-                             workfile);
+    gchar* input = g_strdup_printf("\"%s\"", workfile);
+    gchar* chdir = g_path_get_dirname(basename);
+    texcmd = texlive_get_texpdf_command(typesetter, flags, outdir, workfile,
+                                        input, chdir);
+    g_free(chdir);
+    g_free(input);
   } else if (STR_EQU(method, "texdvipdf")) {
     texcmd = g_strdup_printf("%s pdf "
                              "\"%s\" \"%s\" \"%s\" \"%s\" \"%s\"", script,
@@ -146,6 +207,32 @@ gchar* texlive_get_command(const gchar* method, gchar* workfile,
   return texcmd;
 }
 
+static gchar* texlive_get_texpdf_command(const gchar* typesetter,
+                                         const gchar* flags,
+                                         const gchar* outdir,
+                                         gchar* workfile,
+                                         const gchar* input,
+                                         const gchar* chdir)
+{
+  gchar* format = texlive_get_format(typesetter, workfile, chdir);
+  gchar* texcmd = NULL;
+
+  if (format) {
+    texcmd = g_strdup_printf("%s %s -fmt=\"%s\" %s %s", typesetter,
+                             flags,
+                             format,
+                             outdir,
+                             input);
+    g_free(format);
+  } else {
+    texcmd = g_strdup_printf("%s %s %s %s", typesetter,
+                             flags,
+                             outdir,
+                             input);
+  }
+  return texcmd;
+}
+
 gchar* texlive_get_flags(const gchar* method)
 {
   gchar* flags = g_strdup_printf("-interaction=nonstopmode "
@@ -162,11 +249,351 @@ gchar* texlive_get_flags(const gchar* method)
     flags = tmp;
   }
 
-  if (config_get_value("synctex")) {
+  if (config_get_value("synctex") && !draft_pass) {
     gchar* tmp = g_strconcat(flags, " -synctex=1", NULL);
     g_free(flags);
     flags = tmp;
   }
 
+  /* the .fls file lists every file read, for the dependency tracker */
+  if (latex_recorder_active()) {
+    gchar* tmp = g_strconcat(flags, " -recorder", NULL);
+    g_free(flags);
+    flags = tmp;
+  }
+
   return flags;
 }
+
+void texlive_set_draft(gboolean draft)
+{
+  draft_pass = draft;
+}
+
+gboolean texlive_preamble_cache_active(void)
+{
+  if (!config_get_value("preamble_cache")) return FALSE;
+
+  /* The format is dumped by mylatexformat, which on loading the format
+   * skips everything in the document up to \begin{document} */
+  if (mlf_detected == -1) {
+    Tuple2 res = utils_popen_r("kpsewhich mylatexformat.ltx", NULL);
+    mlf_detected = ((glong)res.first == 0 && res.second != NULL);
+    g_free(res.second);
+    slog(L_INFO, "mylatexformat %s, preamble caching %s\n",
+         mlf_detected ? "found" : "not found",
+         mlf_detected ? "available" : "disabled");
+  }
+  return mlf_detected;
+}
+
+static gchar* texlive_get_preamble_hash(const gchar* typesetter,
+                                        const gchar* workfile)
+{
+  gchar* text = NULL;
+  gchar* end = NULL;
+  gchar* hash = NULL;
+  GChecksum* checksum = NULL;
+
+  if (!g_file_get_contents(workfile, &text, NULL, NULL))
+    return NULL;
+
+  /* The externalization compares the job name against the one it was
+   * dumped with, so such a preamble can not be kept in a format */
+  if ((end = strstr(text, "\\begin{document}")) &&
+      !g_strstr_len(text, end - text, "\\tikzexternalize")) {
+    checksum = g_checksum_new(G_CHECKSUM_MD5);
+    g_checksum_update(checksum, (guchar*)typesetter, -1);
+    g_checksum_update(checksum,
+        (guchar*)(latex_use_shellescaping() ? "+shell" : "-shell"), -1);
+    g_checksum_update(checksum, (guchar*)text, end - text);
+    hash = g_strdup(g_checksum_get_string(checksum));
+    g_checksum_free(checksum);
+  }
+  g_free(text);
+  return hash;
+}
+
+static gchar* texlive_get_deps_stamp(GSList* deps)
+{
+  GString* stamp = g_string_new("");
+  GSList* iter = NULL;
+  GStatBuf st;
+
+  for (iter = deps; iter; iter = iter->next) {
+    if (g_stat(iter->data, &st) == 0) {
+      g_string_append_printf(stamp, "%s:%" G_GINT64_FORMAT ":%"
+                             G_GINT64_FORMAT "\n", (gchar*)iter->data,
+                             (gint64)st.st_mtime, (gint64)st.st_size);
+    } else {
+      g_string_append_printf(stamp, "%s:-\n", (gchar*)iter->data);
+    }
+  }
+  return g_string_free(stamp, FALSE);
+}
+
+static void texlive_format_free(gpointer data)
+{
+  TexliveFormat* fmt = (TexliveFormat*)data;
+
+  if (fmt->path) {
+    gchar* fmtfile = g_strdup_printf("%s.fmt", fmt->path);
+    g_remove(fmtfile);
+    g_free(fmtfile);
+  }
+  g_free(fmt->path);
+  g_slist_free_full(fmt->deps, g_free);
+  g_free(fmt->stamp);
+  g_free(fmt);
+}
+
+static void texlive_evict_formats(void)
+{
+  GHashTableIter iter;
+  gpointer key = NULL;
+  gpointer value = NULL;
+
+  while (g_hash_table_size(formats) >= FMT_CACHE_SIZE) {
+    gpointer oldest = NULL;
+    gint64 used = G_MAXINT64;
+
+    g_hash_table_iter_init(&iter, formats);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      if (((TexliveFormat*)value)->used < used) {
+        used = ((TexliveFormat*)value)->used;
+        oldest = key;
+      }
+    }
+    g_hash_table_remove(formats, oldest);
+  }
+}
+
+static gchar* texlive_get_format(const gchar* typesetter, gchar* workfile,
+                                 const gchar* chdir)
+{
+  TexliveFormat* fmt = NULL;
+  gchar* hash = NULL;
+  gint64 now = g_get_monotonic_time();
+
+  if (!texlive_preamble_cache_active()) return NULL;
+  if (!(hash = texlive_get_preamble_hash(typesetter, workfile))) return NULL;
+
+  if (!formats)
+    formats = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                    texlive_format_free);
+
+  /* Every preamble of the open documents keeps its format, switching tabs
+   * doesn't dump again. A format is stale once one of the local files its
+   * preamble loaded changed. A failed dump is retried then as well, or
+   * once FMT_RETRY_DELAY has passed in case it failed for a passing
+   * reason */
+  if ((fmt = g_hash_table_lookup(formats, hash))) {
+    gchar* stamp = texlive_get_deps_stamp(fmt->deps);
+    gchar* fmtfile = fmt->path ? g_strdup_printf("%s.fmt", fmt->path) : NULL;
+
+    if (!STR_EQU(stamp, fmt->stamp) ||
+        (fmtfile && !utils_path_exists(fmtfile)) ||
+        (!fmt->path &&
+         now - fmt->failed > FMT_RETRY_DELAY * G_USEC_PER_SEC)) {
+      g_hash_table_remove(formats, hash);
+      fmt = NULL;
+    }
+    g_free(fmtfile);
+    g_free(stamp);
+  }
+
+  if (!fmt) {
+    gchar* fmtname = g_strdup_printf("gummi_%s", hash);
+    gchar* fmtpath = g_build_filename(C_TMPDIR, fmtname, NULL);
+    gchar* fmtfile = g_strdup_printf("%s.fmt", fmtpath);
+    gchar* flsfile = g_strdup_printf("%s.fls", fmtpath);
+    gchar* command = g_strdup_printf("%s %s -ini -interaction=nonstopmode "
+                                     "-recorder %s -jobname=\"%s\" "
+                                     "-output-directory=\"%s\" "
+                                     "\"&%s\" mylatexformat.ltx \"%s\"",
+                                     C_TEXSEC,
+                                     typesetter,
+                                     latex_use_shellescaping() ?
+                                       "-shell-escape" : "-no-shell-escape",
+                                     fmtname,
+                                     C_TMPDIR,
+                                     typesetter,
+                                     workfile);
+    gboolean terminated = FALSE;
+
+    slog(L_DEBUG, "Dumping preamble format %s\n", fmtname);
+    Tuple2 res = utils_popen_r(command, chdir);
+
+#ifndef WIN32
+    /* Killed by motion_kill_typesetter or the compile watchdog, that
+     * says nothing about the preamble */
+    terminated = WIFSIGNALED((gint)(glong)res.first);
+#endif
+    fmt = g_new0(TexliveFormat, 1);
+    fmt->deps = deptracker_read_recorder(flsfile);
+    fmt->stamp = texlive_get_deps_stamp(fmt->deps);
+    if ((glong)res.first == 0 && utils_path_exists(fmtfile)) {
+      fmt->path = fmtpath;
+      fmtpath = NULL;
+    } else if (!terminated) {
+      slog(L_WARNING, "Could not dump preamble format, compiling "
+           "without it\n");
+      fmt->failed = now;
+    }
+    if (terminated) {
+      texlive_format_free(fmt);
+      fmt = NULL;
+    } else {
+      texlive_evict_formats();
+      g_hash_table_insert(formats, g_strdup(hash), fmt);
+    }
+
+    g_remove(flsfile);
+    g_free(res.second);
+    g_free(command);
+    g_free(flsfile);
+    g_free(fmtfile);
+    g_free(fmtpath);
+    g_free(fmtname);
+  }
+
+  g_free(hash);
+  if (!fmt) return NULL;
+  fmt->used = now;
+  return g_strdup(fmt->path);
+}
+
+gboolean texlive_warm_active(void)
+{
+#ifdef WIN32
+  return FALSE;
+#else
+  return (config_get_value("warm_typesetter") && texlive_active() &&
+          STR_EQU(config_get_value("compile_steps"), "texpdf"));
+#endif
+}
+
+static gchar* texlive_get_warm_command(gchar* workfile, const gchar* chdir)
+{
+  gchar* typesetter = pdflatex_active() ? C_PDFLATEX : C_XELATEX;
+  gchar* flags = texlive_get_flags("texpdf");
+  gchar* outdir = g_strdup_printf("-output-directory=\"%s\"", C_TMPDIR);
+  gchar* jobname = g_path_get_basename(workfile);
+  gchar* ext = strrchr(jobname, '.');
+  gchar* input = NULL;
+  gchar* texcmd = NULL;
+
+  /* The document is not on the command line, so TeX has to be told the
+   * job name it would have derived from it */
+  if (ext && ext != jobname) *ext = 0;
+
+  /* Wait on the terminal for the go-ahead before touching the document,
+   * \read from the terminal is not allowed in nonstopmode */
+  input = g_strdup_printf("-jobname=\"%s\" '\\scrollmode\\read16 to\\gummigo "
+                          "\\nonstopmode\\input \"%s\"'", jobname, workfile);
+  texcmd = texlive_get_texpdf_command(typesetter, flags, outdir, workfile,
+                                      input, chdir);
+  g_free(flags);
+  g_free(outdir);
+  g_free(jobname);
+  g_free(input);
+  return texcmd;
+}
+
+static gboolean texlive_warm_spawn(const gchar* command, const gchar* chdir)
+{
+  gchar** args = NULL;
+  GError* error = NULL;
+  GuSpawnPolicy policy;
+  gchar* wrapped = process_wrap_command(command);
+
+  process_get_policy(&policy);
+  if (!g_shell_parse_argv(wrapped, NULL, &args, &error) ||
+      !g_spawn_async_with_pipes(chdir, args, NULL,
+                                G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                                process_setup_child, &policy, &warm_pid,
+                                &warm_in, &warm_out, NULL, &error)) {
+    slog(L_ERROR, "Could not start warm typesetter: %s\n", error->message);
+    g_error_free(error);
+    g_strfreev(args);
+    g_free(wrapped);
+    warm_pid = 0;
+    return FALSE;
+  }
+  g_strfreev(args);
+  g_free(wrapped);
+
+  g_free(warm_cmd);
+  warm_cmd = g_strdup(command);
+  g_free(warm_dir);
+  warm_dir = g_strdup(chdir);
+  slog(L_DEBUG, "Typesetter[pid=%d]: Parked\n", warm_pid);
+  return TRUE;
+}
+
+void texlive_warm_stop(void)
+{
+  if (!warm_pid) return;
+
+#ifndef WIN32
+  kill(-warm_pid, SIGTERM);
+  process_forget(warm_pid);
+  waitpid(warm_pid, NULL, 0);
+#endif
+  close(warm_in);
+  close(warm_out);
+  g_spawn_close_pid(warm_pid);
+  slog(L_DEBUG, "Typesetter[pid=%d]: Unparked\n", warm_pid);
+
+  warm_pid = 0;
+  warm_in = -1;
+  warm_out = -1;
+  g_free(warm_cmd);
+  warm_cmd = NULL;
+  g_free(warm_dir);
+  warm_dir = NULL;
+}
+
+Tuple2 texlive_warm_run(gchar* workfile, const gchar* chdir,
+                        GuProcessOutputFunc func, gpointer user)
+{
+  gchar* texcmd = texlive_get_warm_command(workfile, chdir);
+  gchar* command = g_strdup_printf("%s %s", C_TEXSEC, texcmd);
+  Tuple2 res;
+
+  /* The parked typesetter was started for another document, directory,
+   * preamble format or set of flags */
+  if (warm_pid && (!STR_EQU(command, warm_cmd) || !STR_EQU(chdir, warm_dir)))
+    texlive_warm_stop();
+
+  if (!warm_pid && !texlive_warm_spawn(command, chdir)) {
+    g_free(texcmd);
+    g_free(command);
+    texcmd = texlive_get_command("texpdf", workfile, workfile);
+    command = g_strdup_printf("%s %s", C_TEXSEC, texcmd);
+    res = utils_popen_r_full(command, chdir, func, user);
+    g_free(texcmd);
+    g_free(command);
+    return res;
+  }
+
+  /* Release the parked typesetter, closing its terminal afterwards makes
+   * sure it can never block on it again */
+  typesetter_pid = warm_pid;
+  if (write(warm_in, "\n", 1) != 1)
+    slog(L_ERROR, "Could not release warm typesetter\n");
+  close(warm_in);
+  res = utils_popen_collect(warm_pid, warm_out, func, user);
+
+  warm_pid = 0;
+  warm_in = -1;
+  warm_out = -1;
+
+  /* Park the next one right away, so it has finished starting up by the
+   * time the next compile is requested */
+  texlive_warm_spawn(command, chdir);
+
+  g_free(texcmd);
+  g_free(command);
+  return res;
+}
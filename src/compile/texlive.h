@@ -32,6 +32,8 @@
 
 #include <glib.h>
 
+#include "utils.h"
+
 int texlive_init(void);
 
 gboolean texlive_active(void);
@@ -45,4 +47,43 @@ gchar* texlive_get_command(const gchar* method, gchar* workfile,
                            gchar* basename);
 gchar* texlive_get_flags(const gchar *method);
 
+/**
+ * texlive_set_draft:
+ *
+ * Leaves synctex out of the flags of the following compiles while draft is
+ * TRUE. Only to be called from the compile thread.
+ */
+void texlive_set_draft(gboolean draft);
+
+/**
+ * texlive_preamble_cache_active:
+ *
+ * Returns: TRUE if the preamble of texpdf compilations is precompiled into
+ * a format file that is reused until the preamble or a local file it loads
+ * changes.
+ */
+gboolean texlive_preamble_cache_active(void);
+
+/**
+ * texlive_warm_active:
+ *
+ * Returns: TRUE if texpdf compiles are run by a typesetter that was started
+ * ahead of time and waits, with the format already loaded, for the go-ahead
+ * to read the document.
+ */
+gboolean texlive_warm_active(void);
+
+/**
+ * texlive_warm_run:
+ *
+ * Returns: A Tuple2 in the same format as utils_popen_r
+ *
+ * Releases the parked typesetter on workfile and parks a fresh one for the
+ * next compile. If nothing was parked for this command line yet, one is
+ * started on the spot. Output is passed to func while it is read.
+ */
+Tuple2 texlive_warm_run(gchar* workfile, const gchar* chdir,
+                        GuProcessOutputFunc func, gpointer user);
+void texlive_warm_stop(void);
+
 #endif /* __GUMMI_COMPILE_TEXLIVE_H__ */
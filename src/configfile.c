@@ -89,10 +89,39 @@ const gchar config_str[] =
   "compile_status = True\n"
   "compile_scheme = on_idle\n"
   "compile_timer = 1\n"
+  "adaptive_timer = True\n"
+  "compile_timer_min = 150\n"
+  "compile_timeout = 300\n"
+  "compile_cpu_limit = 120\n"
+  "compile_niceness = 10\n"
+  "compile_ioclass = 2\n"
+  "compile_cgroup = False\n"
+  "compile_cpu_weight = 50\n"
+  "compile_memory_max = 2G\n"
+  "background_compile = True\n"
+  "compile_workers = 0\n"
   "\n"
   "[CompileOpts]\n"
   "shellescape = True\n"
   "synctex = False\n"
+  "preamble_cache = True\n"
+  "warm_typesetter = False\n"
+  "output_cache = True\n"
+  "output_cache_size = 64\n"
+  "max_passes = 3\n"
+  "auxtools = True\n"
+  "scratch_in_ram = False\n"
+  "focus_preview = False\n"
+  "includeonly = True\n"
+  "watch_dependencies = True\n"
+  "draft_pass = False\n"
+  "full_build_delay = 5\n"
+  "graphics_cache = True\n"
+  "graphics_cache_size = 256\n"
+  "image_proxies = False\n"
+  "image_proxy_size = 1600\n"
+  "tikz_external = False\n"
+  "tikz_jobs = 0\n"
   "\n"
   "[Misc]\n"
   "recent1 = __NULL__\n"
@@ -55,6 +55,7 @@
 /* Platform dependant constants : */
 
 #define C_TMPDIR utils_get_tmp_tmp_dir()
+#define C_RAMDIR "/dev/shm"
 
 #ifdef WIN32
 #define C_CMDSEP "&&"
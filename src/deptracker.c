@@ -0,0 +1,264 @@
+/**
+ * @file   deptracker.c
+ * @brief  watch the files a document was built from
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "deptracker.h"
+
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "constants.h"
+#include "utils.h"
+
+/* milliseconds for a burst of changes to settle, regenerating a set of
+ * plots touches many files in a row */
+#define DEP_DEBOUNCE 500
+
+static gboolean deptracker_is_source(const gchar* path);
+static void deptracker_on_changed(GFileMonitor* monitor, GFile* file,
+                                  GFile* other, GFileMonitorEvent event,
+                                  gpointer user);
+static gboolean deptracker_notify(gpointer user);
+
+GuDepTracker* deptracker_new(GuDepChangedFunc func, gpointer user)
+{
+  GuDepTracker* dt = g_new0(GuDepTracker, 1);
+
+  dt->monitors = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       g_free, g_object_unref);
+  dt->changed = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                      g_free, NULL);
+  dt->bibliographies = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                             g_free, NULL);
+  dt->timer = 0;
+  dt->func = func;
+  dt->user = user;
+
+  return dt;
+}
+
+static gboolean deptracker_is_source(const gchar* path)
+{
+  /* Files of the TeX installation only change on updates, there are
+   * hundreds of them in every compile */
+  const gchar* system[] = { "/usr/", "/etc/", "/var/", "/opt/", NULL };
+  gchar* cachedir = NULL;
+  gboolean cached = FALSE;
+  gint i = 0;
+
+  /* Workfiles are rewritten by Gummi itself before every compile, and so
+   * are the converted graphics and TikZ figures in its cache, which it
+   * prunes while compiling */
+  if (g_str_has_prefix(path, C_TMPDIR)) return FALSE;
+  cachedir = g_strconcat(g_get_user_cache_dir(), G_DIR_SEPARATOR_S "gummi"
+                         G_DIR_SEPARATOR_S, NULL);
+  cached = g_str_has_prefix(path, cachedir);
+  g_free(cachedir);
+  if (cached) return FALSE;
+  if (g_str_has_suffix(path, ".swp")) return FALSE;
+  if (strstr(path, G_DIR_SEPARATOR_S "texmf") ||
+      strstr(path, G_DIR_SEPARATOR_S "texlive" G_DIR_SEPARATOR_S))
+    return FALSE;
+  for (i = 0; system[i]; ++i) {
+    if (g_str_has_prefix(path, system[i])) return FALSE;
+  }
+  return TRUE;
+}
+
+GSList* deptracker_read_recorder(const gchar* flsfile)
+{
+  GHashTable* outputs = NULL;
+  GHashTable* seen = NULL;
+  GSList* inputs = NULL;
+  GSList* result = NULL;
+  GSList* iter = NULL;
+  gchar* contents = NULL;
+  gchar** lines = NULL;
+  gchar* pwd = NULL;
+  gint i = 0;
+
+  if (!g_file_get_contents(flsfile, &contents, NULL, NULL)) return NULL;
+
+  outputs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  seen = g_hash_table_new(g_str_hash, g_str_equal);
+  lines = g_strsplit(contents, "\n", -1);
+  for (i = 0; lines[i]; ++i) {
+    gchar* line = g_strchomp(lines[i]);
+    gchar* path = NULL;
+
+    if (g_str_has_prefix(line, "PWD ")) {
+      g_free(pwd);
+      pwd = g_strdup(line + 4);
+      continue;
+    }
+    if (g_str_has_prefix(line, "INPUT ")) line += 6;
+    else if (g_str_has_prefix(line, "OUTPUT ")) line += 7;
+    else continue;
+
+    if (g_path_is_absolute(line) || !pwd)
+      path = g_strdup(line);
+    else
+      path = g_build_filename(pwd, line, NULL);
+
+    /* Anything TeX wrote itself (.aux, .toc, ...) is read back in the
+     * same run, it never is a reason to compile again */
+    if (lines[i][0] == 'O')
+      g_hash_table_insert(outputs, path, NULL);
+    else
+      inputs = g_slist_prepend(inputs, path);
+  }
+
+  for (iter = inputs; iter; iter = iter->next) {
+    gchar* path = (gchar*)iter->data;
+    if (g_hash_table_contains(outputs, path) ||
+        g_hash_table_contains(seen, path) || !deptracker_is_source(path)) {
+      g_free(path);
+      continue;
+    }
+    g_hash_table_insert(seen, path, NULL);
+    result = g_slist_prepend(result, path);
+  }
+
+  g_slist_free(inputs);
+  g_hash_table_unref(seen);
+  g_hash_table_unref(outputs);
+  g_strfreev(lines);
+  g_free(contents);
+  g_free(pwd);
+  return result;
+}
+
+void deptracker_update(GuDepTracker* dt, const gchar* flsfile,
+                       GSList* bibliographies)
+{
+  GHashTable* monitors = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, g_object_unref);
+  GSList* inputs = deptracker_read_recorder(flsfile);
+  GSList* iter = NULL;
+  GError* err = NULL;
+
+  /* bibtex and biber read the databases, TeX never records them */
+  g_hash_table_remove_all(dt->bibliographies);
+  for (iter = bibliographies; iter; iter = iter->next) {
+    g_hash_table_insert(dt->bibliographies, g_strdup(iter->data), NULL);
+    inputs = g_slist_prepend(inputs, g_strdup(iter->data));
+  }
+
+  for (iter = inputs; iter; iter = iter->next) {
+    gchar* path = (gchar*)iter->data;
+    gpointer monitor = NULL;
+
+    if (g_hash_table_contains(monitors, path)) continue;
+
+    /* Keep the monitors of files that are still in use, so no change
+     * slips through in between */
+    if ((monitor = g_hash_table_lookup(dt->monitors, path))) {
+      g_object_ref(monitor);
+      g_hash_table_remove(dt->monitors, path);
+    } else {
+      GFile* file = g_file_new_for_path(path);
+      monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, &err);
+      g_object_unref(file);
+      if (!monitor) {
+        slog(L_DEBUG, "Can't watch %s: %s\n", path, err->message);
+        g_clear_error(&err);
+        continue;
+      }
+      g_signal_connect(monitor, "changed",
+                       G_CALLBACK(deptracker_on_changed), dt);
+    }
+    g_hash_table_insert(monitors, g_strdup(path), monitor);
+  }
+  g_slist_free_full(inputs, g_free);
+
+  /* whatever is left over is no dependency anymore */
+  g_hash_table_unref(dt->monitors);
+  dt->monitors = monitors;
+  slog(L_DEBUG, "Watching %u dependencies\n",
+       g_hash_table_size(dt->monitors));
+}
+
+static void deptracker_on_changed(GFileMonitor* monitor, GFile* file,
+                                  GFile* other, GFileMonitorEvent event,
+                                  gpointer user)
+{
+  GuDepTracker* dt = GU_DEP_TRACKER(user);
+
+  if (event != G_FILE_MONITOR_EVENT_CHANGED &&
+      event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+      event != G_FILE_MONITOR_EVENT_CREATED &&
+      event != G_FILE_MONITOR_EVENT_DELETED)
+    return;
+
+  g_hash_table_insert(dt->changed, g_file_get_path(file), NULL);
+
+  /* restart the countdown on every change of the burst */
+  if (dt->timer) g_source_remove(dt->timer);
+  dt->timer = g_timeout_add(DEP_DEBOUNCE, deptracker_notify, dt);
+}
+
+static gboolean deptracker_notify(gpointer user)
+{
+  GuDepTracker* dt = GU_DEP_TRACKER(user);
+  gboolean bibliography = FALSE;
+  GHashTableIter iter;
+  gpointer path = NULL;
+
+  g_hash_table_iter_init(&iter, dt->changed);
+  while (g_hash_table_iter_next(&iter, &path, NULL)) {
+    slog(L_DEBUG, "Dependency changed: %s\n", (gchar*)path);
+    if (g_str_has_suffix((gchar*)path, ".bib") ||
+        g_hash_table_contains(dt->bibliographies, path))
+      bibliography = TRUE;
+  }
+  g_hash_table_remove_all(dt->changed);
+  dt->timer = 0;
+
+  dt->func(bibliography, dt->user);
+  return FALSE;
+}
+
+void deptracker_clear(GuDepTracker* dt)
+{
+  if (dt->timer) g_source_remove(dt->timer);
+  dt->timer = 0;
+  g_hash_table_remove_all(dt->changed);
+  g_hash_table_remove_all(dt->monitors);
+  g_hash_table_remove_all(dt->bibliographies);
+}
+
+void deptracker_free(GuDepTracker* dt)
+{
+  deptracker_clear(dt);
+  g_hash_table_unref(dt->monitors);
+  g_hash_table_unref(dt->changed);
+  g_hash_table_unref(dt->bibliographies);
+  g_free(dt);
+}
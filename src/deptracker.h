@@ -0,0 +1,91 @@
+/**
+ * @file   deptracker.h
+ * @brief  watch the files a document was built from
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GUMMI_DEPTRACKER_H__
+#define __GUMMI_DEPTRACKER_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+
+/**
+ * GuDepChangedFunc:
+ * @bibliography: TRUE if one of the changed files is a bibliography
+ * @user: user data passed to deptracker_new
+ *
+ * Called on the main loop once a burst of changes has settled.
+ */
+typedef void (*GuDepChangedFunc)(gboolean bibliography, gpointer user);
+
+/**
+ * GuDepTracker:
+ * @monitors: watched path mapped to its GFileMonitor
+ * @changed: paths that changed since the last notification
+ * @bibliographies: the watched paths that are bibliographies
+ * @timer: source id of the pending notification, or 0
+ *
+ * Keeps a file monitor on every input TeX recorded for the last compile,
+ * and on the bibliographies it cited.
+ */
+#define GU_DEP_TRACKER(x) ((GuDepTracker*)x)
+typedef struct _GuDepTracker GuDepTracker;
+
+struct _GuDepTracker {
+  GHashTable* monitors;
+  GHashTable* changed;
+  GHashTable* bibliographies;
+  guint timer;
+
+  GuDepChangedFunc func;
+  gpointer user;
+};
+
+GuDepTracker* deptracker_new(GuDepChangedFunc func, gpointer user);
+
+/**
+ * deptracker_read_recorder:
+ *
+ * Parses the -recorder output of a compile. Files TeX wrote and files of
+ * the TeX installation are left out. Safe to call from any thread.
+ *
+ * Returns: A newly allocated list of newly allocated absolute paths.
+ */
+GSList* deptracker_read_recorder(const gchar* flsfile);
+
+/**
+ * deptracker_update:
+ *
+ * Replaces the watched files with the inputs recorded in flsfile and the
+ * paths in bibliographies. Must be called from the main loop.
+ */
+void deptracker_update(GuDepTracker* dt, const gchar* flsfile,
+                       GSList* bibliographies);
+void deptracker_clear(GuDepTracker* dt);
+void deptracker_free(GuDepTracker* dt);
+
+#endif /* __GUMMI_DEPTRACKER_H__ */
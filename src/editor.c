@@ -44,12 +44,14 @@
 #include "configfile.h"
 #include "constants.h"
 #include "environment.h"
+#include "logparser.h"
 #include "utils.h"
 
 static void on_inserted_text(GtkTextBuffer *textbuffer, GtkTextIter *location,
                              gchar *text, gint len, gpointer user_data);
 static void on_delete_range(GtkTextBuffer *textbuffer, GtkTextIter *start,
                             GtkTextIter *end, gpointer user_data);
+static void on_buffer_changed(GtkTextBuffer *textbuffer, gpointer user_data);
 
 const gchar style[][3][20] = {
   { "tool_bold", "\\textbf{", "}" },
@@ -71,6 +73,12 @@ GuEditor* editor_new(GuMotion* mc)
   ec->basename = NULL;   /* use this to form .dvi/.ps/.log etc. files */
   ec->pdffile = NULL;
   ec->workfile = NULL;
+  ec->workhash = NULL;  /* checksum of the last written workfile */
+  ec->worktext = NULL;  /* content of the workfile behind workfd */
+  ec->focusfile = NULL; /* transient document for the focus preview */
+  ec->focuspdf = NULL;
+  ec->backgroundfile = NULL; /* copy of the buffer compiled in background */
+  ec->state = motion_state_new(ec);
   ec->bibfile = NULL;
   ec->projfile = NULL;
 
@@ -113,6 +121,8 @@ GuEditor* editor_new(GuMotion* mc)
                                         G_CALLBACK(on_inserted_text), ec);
   ec->sigid[4] = g_signal_connect_after(ec->buffer, "delete-range",
                                         G_CALLBACK(on_delete_range), ec);
+  ec->sigid[5] = g_signal_connect(ec->buffer, "changed",
+                                  G_CALLBACK(on_buffer_changed), ec);
 
   return ec;
 }
@@ -126,12 +136,13 @@ void editor_destroy(GuEditor* ec)
       g_signal_handler_disconnect(ec->view, ec->sigid[i]);
     }
   }
-  for (i = 2; i < 5; ++i) {
+  for (i = 2; i < 6; ++i) {
     if (g_signal_handler_is_connected(ec->buffer, ec->sigid[i])) {
       g_signal_handler_disconnect(ec->buffer, ec->sigid[i]);
     }
   }
 
+  motion_state_release(ec->state);
   editor_fileinfo_cleanup(ec);
   g_object_unref(ec->view);
   g_object_unref(ec->buffer);
@@ -167,6 +178,14 @@ static void on_delete_range(GtkTextBuffer *textbuffer, GtkTextIter *start,
   e->sync_to_last_edit = TRUE;
 }
 
+static void on_buffer_changed(GtkTextBuffer *textbuffer, gpointer user_data)
+{
+  GuEditor* e = GU_EDITOR(user_data);
+
+  /* the text has to be looked at again before compiling it in background */
+  e->state->dirty = TRUE;
+}
+
 /* FileInfo:
  * When a TeX document includes materials from other files (image, documents,
  * bibliography ... etc), pdflatex will try to find those files under the
@@ -193,7 +212,7 @@ static void on_delete_range(GtkTextBuffer *textbuffer, GtkTextIter *start,
 void editor_fileinfo_update(GuEditor* ec, const gchar* filename)
 {
 
-  if (ec->workfd != -1)
+  if (ec->fdname)
     editor_fileinfo_cleanup(ec);
 
   ec->fdname = g_build_filename(C_TMPDIR, "gummi_XXXXXX", NULL);
@@ -203,7 +222,8 @@ void editor_fileinfo_update(GuEditor* ec, const gchar* filename)
   // be the proper way for *nix, but I don't want to change this
   // crucial piece of code at this stage of development -alexander
 #ifdef WIN32
-  close(ec->workfd);
+  if (ec->workfd != -1) close(ec->workfd);
+  ec->workfd = -1;
 #endif
 
   if (filename) {
@@ -219,9 +239,19 @@ void editor_fileinfo_update(GuEditor* ec, const gchar* filename)
     gchar* dir = g_path_get_dirname(fname);
     ec->filename = g_strdup(fname);
     ec->basename = g_strdup_printf("%s%c.%s", dir, G_DIR_SEPARATOR, base);
-    ec->workfile = g_strdup_printf("%s.swp", ec->basename);
+    /* In scratch mode the workfile stays out of the document directory,
+     * the temp directory is memory backed then */
+    if (config_get_value("scratch_in_ram"))
+      ec->workfile = g_strdup_printf("%s%c.%s.swp", C_TMPDIR,
+                                     G_DIR_SEPARATOR, base);
+    else
+      ec->workfile = g_strdup_printf("%s.swp", ec->basename);
     ec->pdffile =  g_strdup_printf("%s%c.%s.pdf", C_TMPDIR,
                                    G_DIR_SEPARATOR, base);
+
+    /* workfd belongs to the workfile, which is opened on the first write */
+    if (ec->workfd != -1) close(ec->workfd);
+    ec->workfd = -1;
     g_free(fname);
     g_free(base);
     g_free(dir);
@@ -230,6 +260,20 @@ void editor_fileinfo_update(GuEditor* ec, const gchar* filename)
     ec->basename = g_strdup(ec->fdname);
     ec->pdffile =  g_strdup_printf("%s.pdf", ec->fdname);
   }
+
+  /* The focus preview document only ever lives in the temp directory */
+  ec->focusfile = g_strdup_printf("%s_focus", ec->fdname);
+  ec->focuspdf = g_strdup_printf("%s_focus.pdf", ec->fdname);
+  ec->backgroundfile = g_strdup_printf("%s_background", ec->fdname);
+}
+
+gchar* editor_get_compile_dir(GuEditor* ec)
+{
+  /* relative inputs of the document resolve from its own directory, no
+   * matter where the workfile lives */
+  if (ec->filename)
+    return g_path_get_dirname(ec->filename);
+  return g_path_get_dirname(ec->workfile);
 }
 
 gboolean editor_fileinfo_update_biblio(GuEditor* ec,  const gchar* filename)
@@ -284,6 +328,9 @@ void editor_fileinfo_cleanup(GuEditor* ec)
   g_remove(ec->workfile);
   g_remove(ec->pdffile);
   g_remove(ec->basename);
+  g_remove(ec->focusfile);
+  g_remove(ec->focuspdf);
+  g_remove(ec->backgroundfile);
 
   g_free(auxfile);
   g_free(logfile);
@@ -293,12 +340,22 @@ void editor_fileinfo_cleanup(GuEditor* ec)
   g_free(ec->workfile);
   g_free(ec->pdffile);
   g_free(ec->basename);
+  g_free(ec->workhash);
+  g_free(ec->worktext);
+  g_free(ec->focusfile);
+  g_free(ec->focuspdf);
+  g_free(ec->backgroundfile);
 
   ec->fdname = NULL;
   ec->filename = NULL;
   ec->workfile = NULL;
   ec->pdffile = NULL;
   ec->basename = NULL;
+  ec->workhash = NULL;
+  ec->worktext = NULL;
+  ec->focusfile = NULL;
+  ec->focuspdf = NULL;
+  ec->backgroundfile = NULL;
 }
 
 void editor_sourceview_config(GuEditor* ec)
@@ -507,21 +564,36 @@ cleanup:
   g_regex_unref(match_str);
 }
 
-void editor_apply_errortags(GuEditor* ec, gint* lines)
+void editor_apply_errortags(GuEditor* ec, GSList* entries)
 {
   GtkTextIter start, end;
-  gint count = 0;
+  GSList* iter = NULL;
+  gchar* workname = g_path_get_basename(ec->workfile);
+  gchar* filename = ec->filename ? g_path_get_basename(ec->filename) : NULL;
+
   /* remove the tag from the table if it is in threre */
   if (gtk_text_tag_table_lookup(ec->editortags, "error"))
     gtk_text_tag_table_remove(ec->editortags, ec->errortag);
 
   gtk_text_tag_table_add(ec->editortags, ec->errortag);
-  while (lines[count]) {
-    gtk_text_buffer_get_iter_at_line(ec_buffer, &start, lines[count] - 1);
-    gtk_text_buffer_get_iter_at_line(ec_buffer, &end, lines[count]);
+  for (iter = entries; iter; iter = iter->next) {
+    GuLogEntry* entry = GU_LOG_ENTRY(iter->data);
+    if (entry->severity != LOG_ERROR || entry->line <= 0) continue;
+
+    /* errors in included files don't belong in this buffer, unless this
+     * buffer is the included file of a project build */
+    if (entry->file) {
+      gchar* name = g_path_get_basename(entry->file);
+      gboolean own = STR_EQU(name, workname) || STR_EQU(name, filename);
+      g_free(name);
+      if (!own) continue;
+    }
+    gtk_text_buffer_get_iter_at_line(ec_buffer, &start, entry->line - 1);
+    gtk_text_buffer_get_iter_at_line(ec_buffer, &end, entry->line);
     gtk_text_buffer_apply_tag(ec_buffer, ec->errortag, &start, &end);
-    ++count;
   }
+  g_free(workname);
+  g_free(filename);
 }
 
 void editor_jumpto_search_result(GuEditor* ec, gint direction)
@@ -59,6 +59,12 @@ struct _GuEditor {
   gchar* workfile;
   gchar* bibfile;
   gchar* projfile;
+  gchar* workhash;
+  gchar* worktext;
+  gchar* focusfile;
+  gchar* focuspdf;
+  gchar* backgroundfile;
+  struct _GuCompileState* state;
 
   /* GUI related members */
   GtkSourceView* view;
@@ -72,7 +78,7 @@ struct _GuEditor {
   gboolean backwards;
   gboolean wholeword;
   gboolean matchcase;
-  gint sigid[5];
+  gint sigid[6];
 
   GtkTextIter last_edit;
   gboolean sync_to_last_edit;
@@ -82,6 +88,9 @@ GuEditor* editor_new(GuMotion* mc);
 void editor_fileinfo_update(GuEditor* ec, const gchar* filename);
 void editor_fileinfo_cleanup(GuEditor* ec);
 gboolean editor_fileinfo_update_biblio(GuEditor* ec,  const gchar* filename);
+
+/* editor_get_compile_dir will return a newly allocated string */
+gchar* editor_get_compile_dir(GuEditor* ec);
 void editor_destroy(GuEditor* ec);
 void editor_sourceview_config(GuEditor* ec);
 #ifdef USE_GTKSPELL
@@ -95,7 +104,7 @@ void editor_insert_package(GuEditor* ec, const gchar* package,
                            const gchar* options);
 void editor_insert_bib(GuEditor* ec, const gchar* package);
 void editor_set_selection_textstyle(GuEditor* ec, const gchar* type);
-void editor_apply_errortags(GuEditor* ec, gint* lines);
+void editor_apply_errortags(GuEditor* ec, GSList* entries);
 void editor_jumpto_search_result(GuEditor* ec, gint direction);
 void editor_start_search(GuEditor* ec, const gchar* term, gboolean backwards,
                          gboolean wholeword, gboolean matchcase);
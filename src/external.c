@@ -29,17 +29,57 @@
 
 #include "external.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "cache.h"
 #include "constants.h"
+#include "process.h"
 #include "utils.h"
 
+typedef struct {
+  gchar* program;
+  gchar* key;
+  gchar* output;
+} ExternalProbe;
+
 /* local functions */
-static gchar* get_version_output(const gchar* command, int linenr);
+static gchar* get_version_key(const gchar* program);
+static gchar* get_version_output(const gchar* program);
 static gchar* version_latexmk(const gchar* output);
 static gchar* version_rubber(const gchar* output);
+static gpointer external_probe_thread(gpointer data);
+static gboolean external_probe_done(gpointer data);
+static gboolean external_probe_idle(gpointer user);
+static void external_probe_free(gpointer data);
 
 
-static gdouble get_texlive_version(void);
+static gdouble get_texlive_version(const gchar* output);
 
+/* --version outputs of earlier starts, spawning the tools takes a while */
+static GuCache* probes = NULL;
+/* everything below is protected by pending_mutex */
+static GMutex pending_mutex;
+static GSList* pending = NULL;
+/* keys probed this session, a failed probe is not repeated */
+static GHashTable* probed = NULL;
+static gboolean probing = FALSE;
+static guint probe_source = 0;
+static GSourceFunc probe_done = NULL;
+static gpointer probe_user = NULL;
+
+
+void external_init(void)
+{
+  gchar* dir = g_build_filename(g_get_user_cache_dir(), "gummi",
+                                "externals", NULL);
+  probes = cache_init(dir);
+  probed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  g_free(dir);
+}
 
 gboolean external_exists(const gchar* program)
 {
@@ -56,65 +96,250 @@ gboolean external_hasflag(const gchar* program, const gchar* flag)
   return TRUE;
 }
 
-static gchar* get_version_output(const gchar* command, int linenr)
+static gchar* get_version_key(const gchar* program)
 {
-  const gchar* getversion = g_strdup_printf("%s --version", command);
-  Tuple2 cmdgetv = utils_popen_r(getversion, NULL);
-  gchar* output = (gchar*)cmdgetv.second;
-  gchar* result = g_strdup("Unknown");
+  gchar* fullpath = g_find_program_in_path(program);
+  gchar* resolved = NULL;
+  gchar* stamp = NULL;
+  gchar* key = NULL;
+  GStatBuf st;
+
+  if (fullpath == NULL) return NULL;
+
+  /* latex, pdflatex, .. are links to the binary an update replaces */
+#ifdef WIN32
+  resolved = g_strdup(fullpath);
+#else
+  char* real = realpath(fullpath, NULL);
+  resolved = g_strdup(real ? real : fullpath);
+  free(real);
+#endif
+
+  if (g_stat(resolved, &st) == 0) {
+    stamp = g_strdup_printf("%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                            (gint64)st.st_mtime, (gint64)st.st_size);
+    /* the links print different versions, so program is part of it */
+    key = cache_get_key("external", program, resolved, stamp, NULL);
+    g_free(stamp);
+  }
+  g_free(resolved);
+  g_free(fullpath);
+  return key;
+}
+
+static gchar* get_version_output(const gchar* program)
+{
+  gchar* key = get_version_key(program);
+  gchar* entry = NULL;
+  gchar* output = NULL;
+
+  if (key == NULL) return NULL;
+
+  if (probes && (entry = cache_lookup(probes, key))) {
+    gchar* file = g_build_filename(entry, "version", NULL);
+    g_file_get_contents(file, &output, NULL, NULL);
+    g_free(file);
+    g_free(entry);
+  }
 
   if (output == NULL) {
-    slog(L_ERROR, "Error detecting version for %s. "
-         "Please report a bug\n", command);
-    return result;
+    g_mutex_lock(&pending_mutex);
+    if (!g_hash_table_contains(probed, key) &&
+        !g_slist_find_custom(pending, program, (GCompareFunc)strcmp)) {
+      pending = g_slist_append(pending, g_strdup(program));
+      /* a miss after the last probe has finished starts another one */
+      if (!probing && probe_done && !probe_source)
+        probe_source = g_idle_add(external_probe_idle, NULL);
+    }
+    g_mutex_unlock(&pending_mutex);
   }
 
-  gchar** splitted = g_strsplit(output, "\n", BUFSIZ);
-  result = splitted[linenr];
-  return result;
+  g_free(key);
+  return output;
 }
 
 gdouble external_version2(ExternalProg program)
 {
+  gchar* output = NULL;
+  gdouble version = -1;
 
   switch (program) {
   case EX_TEXLIVE:
-    return get_texlive_version();
+    if ((output = get_version_output(C_LATEX))) {
+      /* the year is on the first line only */
+      output[strcspn(output, "\n")] = '\0';
+      version = get_texlive_version(output);
+    }
+    break;
   default:
-    return -1;
+    break;
   }
+  g_free(output);
+  return version;
 }
 
 gchar* external_version(const gchar* program)
 {
-  const gchar* getversion = g_strdup_printf("%s --version", program);
-  Tuple2 cmdgetv = utils_popen_r(getversion, NULL);
-  gchar* output = (gchar*)cmdgetv.second;
+  gchar* output = get_version_output(program);
+  gchar* result = NULL;
 
-  gchar* result = g_strdup("Unknown, please report a bug");
-
-  if (output == NULL) return result;
+  if (output == NULL) return NULL;
 
   gchar** lines = g_strsplit(output, "\n", BUFSIZ);
-  result = lines[0];
 
   /* pdfTeX 3.1415926-1.40.10 (TeX Live 2009)
      pdfTeX 3.1415926-1.40.11-2.2 (TeX Live 2010)
      pdfTeX 3.1415926-2.3-1.40.12 (TeX Live 2011)
   */
-  if (STR_EQU(program, C_RUBBER)) {
-    result = version_rubber(result);
+  if (lines[0] == NULL) {
+    result = NULL;
+  } else if (STR_EQU(program, C_RUBBER)) {
+    result = version_rubber(lines[0]);
   } else if (STR_EQU(program, C_LATEXMK)) {
     result = version_latexmk(lines[1]);
+  } else {
+    result = g_strdup(lines[0]);
   }
 
-  return result;
+  g_strfreev(lines);
+  g_free(output);
+  return result ? result : g_strdup("Unknown, please report a bug");
 }
 
-static gdouble get_texlive_version(void)
+gboolean external_probe_pending(GSourceFunc done, gpointer user)
+{
+  GSList* programs = NULL;
+  GSList* iter = NULL;
+  gboolean waiting = FALSE;
+
+  g_mutex_lock(&pending_mutex);
+  probe_done = done;
+  probe_user = user;
+  if (!probing) {
+    programs = pending;
+    pending = NULL;
+  }
+  /* the running probe picks the new misses up when it is done */
+  waiting = probing && pending;
+  g_mutex_unlock(&pending_mutex);
+
+  for (iter = programs; iter; iter = iter->next) {
+    gchar* key = get_version_key(iter->data);
+    if (key == NULL) {
+      g_free(iter->data);
+      iter->data = NULL;
+      continue;
+    }
+    ExternalProbe* probe = g_new0(ExternalProbe, 1);
+    probe->program = iter->data;
+    probe->key = key;
+    iter->data = probe;
+  }
+  programs = g_slist_remove_all(programs, NULL);
+  if (programs == NULL) return waiting;
+
+  g_mutex_lock(&pending_mutex);
+  probing = TRUE;
+  for (iter = programs; iter; iter = iter->next) {
+    g_hash_table_insert(probed,
+                        g_strdup(((ExternalProbe*)iter->data)->key), NULL);
+  }
+  g_mutex_unlock(&pending_mutex);
+
+  g_thread_unref(g_thread_new("externals", external_probe_thread, programs));
+  return TRUE;
+}
+
+static gboolean external_probe_idle(gpointer user)
+{
+  GSourceFunc done = NULL;
+
+  g_mutex_lock(&pending_mutex);
+  probe_source = 0;
+  done = probe_done;
+  user = probe_user;
+  g_mutex_unlock(&pending_mutex);
+
+  external_probe_pending(done, user);
+  return FALSE;
+}
+
+static gpointer external_probe_thread(gpointer data)
+{
+  GSList* iter = NULL;
+
+  /* Only spawn here. The cache and the pid of the typesetter belong to
+   * the main loop */
+  for (iter = data; iter; iter = iter->next) {
+    ExternalProbe* probe = (ExternalProbe*)iter->data;
+    gchar* getversion = g_strdup_printf("%s --version", probe->program);
+    GError* err = NULL;
+    GuProcess* proc = NULL;
+
+    slog(L_DEBUG, "Probing version of %s\n", probe->program);
+    if ((proc = process_spawn_full(getversion, NULL, NULL, &err))) {
+      process_wait(proc);
+      probe->output = process_steal_output(proc);
+      process_free(proc);
+    } else {
+      g_error_free(err);
+    }
+    g_free(getversion);
+  }
+
+  g_idle_add(external_probe_done, data);
+  return NULL;
+}
+
+static gboolean external_probe_done(gpointer data)
+{
+  GSList* programs = (GSList*)data;
+  GSList* iter = NULL;
+  GSourceFunc done = NULL;
+  gpointer user = NULL;
+  gboolean again = FALSE;
+
+  for (iter = programs; iter; iter = iter->next) {
+    ExternalProbe* probe = (ExternalProbe*)iter->data;
+    if (probe->output == NULL) {
+      slog(L_ERROR, "Error detecting version for %s. "
+           "Please report a bug\n", probe->program);
+    } else if (probes) {
+      cache_store_contents(probes, probe->key, "version", probe->output);
+    }
+  }
+  g_slist_free_full(programs, external_probe_free);
+  /* outputs of replaced binaries are never looked up again */
+  if (probes) cache_evict(probes, 1024 * 1024);
+
+  g_mutex_lock(&pending_mutex);
+  probing = FALSE;
+  done = probe_done;
+  user = probe_user;
+  g_mutex_unlock(&pending_mutex);
+
+  /* lookups done meanwhile or from done may have missed again */
+  done(user);
+  g_mutex_lock(&pending_mutex);
+  again = pending != NULL;
+  g_mutex_unlock(&pending_mutex);
+  if (again) external_probe_pending(done, user);
+  return FALSE;
+}
+
+static void external_probe_free(gpointer data)
+{
+  ExternalProbe* probe = (ExternalProbe*)data;
+
+  g_free(probe->program);
+  g_free(probe->key);
+  g_free(probe->output);
+  g_free(probe);
+}
+
+static gdouble get_texlive_version(const gchar* output)
 {
   gdouble version = 0;
-  gchar* output = get_version_output(C_LATEX, 0);
 
   /* Keep in mind that some distros like themselves a lot:
    * pdfTeX 3.1415926-1.40.11-2.2 (TeX Live 2010)
@@ -154,7 +379,11 @@ static gchar* version_rubber(const gchar* output)
 {
   /* format: Rubber version: 1.1 */
   gchar** version = g_strsplit(output, " ", BUFSIZ);
-  return version[2];
+  gchar* result = NULL;
+
+  if (g_strv_length(version) > 2) result = g_strdup(version[2]);
+  g_strfreev(version);
+  return result;
 }
 
 static gchar* version_latexmk(const gchar* output)
@@ -162,6 +391,13 @@ static gchar* version_latexmk(const gchar* output)
   /* latexmk --version seems to print the requested information after a \n
      format: Latexmk, John Collins, 24 March 2011. Version 4.23a */
 
-  gchar** version = g_strsplit(output, " ", BUFSIZ);
-  return version[7];
+  gchar** version = NULL;
+  gchar* result = NULL;
+
+  if (output == NULL) return NULL;
+
+  version = g_strsplit(output, " ", BUFSIZ);
+  if (g_strv_length(version) > 7) result = g_strdup(version[7]);
+  g_strfreev(version);
+  return result;
 }
@@ -48,10 +48,38 @@ typedef enum _ExternalProg {
 } ExternalProg;
 
 
+void external_init(void);
 gboolean external_exists(const gchar* program);
 gboolean external_hasflag(const gchar* program, const gchar* flag);
 
+/**
+ * external_version:
+ *
+ * Returns: A newly allocated version string of program, or NULL if the
+ * installed binary has not been probed yet. Versions are cached by the
+ * resolved path, mtime and size of the binary and never spawned from here,
+ * a miss queues program for external_probe_pending.
+ */
 gchar* external_version(const gchar* program);
+
+/**
+ * external_version2:
+ *
+ * Returns: The version of program as a number, -1 if unknown. Looked up
+ * the same way as external_version.
+ */
 gdouble external_version2(ExternalProg program);
 
+/**
+ * external_probe_pending:
+ *
+ * Runs the --version probes the lookups since the last call missed on a
+ * thread, the outputs are stored in the cache from the main loop and done
+ * is called there afterwards. Misses of later lookups are probed the same
+ * way without another call, each binary at most once per session.
+ *
+ * Returns: FALSE if there was nothing to probe and done won't be called.
+ */
+gboolean external_probe_pending(GSourceFunc done, gpointer user);
+
 #endif /* __GUMMI_EXTERNAL_H__ */
@@ -0,0 +1,539 @@
+/**
+ * @file   graphics.c
+ * @brief  conversion of graphics TeX can't include directly
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "graphics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "configfile.h"
+#include "constants.h"
+#include "external.h"
+#include "utils.h"
+
+/* name of the converted file inside a cache entry */
+#define CONVERTED_NAME "converted.pdf"
+/* marks an image that needs no proxy inside a cache entry */
+#define UNSCALED_NAME "unscaled"
+/* images smaller than this are read quickly enough as they are */
+#define PROXY_MIN_SIZE (1 << 20)
+/* the name of an included graphic is its first group */
+#define INCLUDEGRAPHICS "\\\\includegraphics\\*?(?:\\[[^\\]]*\\])*" \
+                        "\\{\\s*([^}]+?)\\s*\\}"
+
+static gboolean graphics_resolve(const gchar* curdir, const gchar* name,
+                                 gchar** source, gchar** target);
+static const gchar* graphics_get_converter(const gchar* ext);
+static gchar* graphics_convert(GuGraphics* gc, const gchar* source,
+                               const gchar* converter);
+static void graphics_publish(const gchar* cached, const gchar* dest);
+static const gchar* graphics_get_resizer(void);
+static gboolean graphics_resolve_raster(const gchar* curdir,
+                                        const gchar* name, gchar** source,
+                                        gchar** target);
+static gchar* graphics_make_proxy(GuGraphics* gc, const gchar* source);
+static gboolean graphics_get_proxy_command(const gchar* source,
+                                           const gchar* output,
+                                           gint maxsize, gchar** command);
+
+GuGraphics* graphics_init(void)
+{
+  GuGraphics* g = g_new0(GuGraphics, 1);
+  gchar* cachedir = g_build_filename(g_get_user_cache_dir(), "gummi",
+                                     "graphics", NULL);
+
+  g->cache = cache_init(cachedir);
+  g->dir = g_build_filename(C_TMPDIR, "graphics", NULL);
+  g_mkdir_with_parents(g->dir, DIR_PERMS);
+  g->converted = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       g_free, NULL);
+  g->checksums = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       g_free, g_free);
+  g->proxydir = g_build_filename(C_TMPDIR, "proxies", NULL);
+  g_mkdir_with_parents(g->proxydir, DIR_PERMS);
+  g->proxies = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  g_free(cachedir);
+
+  return g;
+}
+
+gboolean graphics_cache_active(void)
+{
+  return TO_BOOL(config_get_value("graphics_cache"));
+}
+
+gboolean graphics_proxies_active(void)
+{
+  if (!config_get_value("image_proxies")) return FALSE;
+  return graphics_get_resizer() != NULL;
+}
+
+static const gchar* graphics_get_resizer(void)
+{
+  /* ImageMagick 7 has a single binary, 6 one per tool */
+  if (external_exists("magick")) return "magick";
+  if (external_exists("identify") && external_exists("convert"))
+    return "convert";
+  return NULL;
+}
+
+static const gchar* graphics_get_converter(const gchar* ext)
+{
+  /* %1$s is the output, %2$s the input file */
+  if (STR_EQU(ext, "eps") || STR_EQU(ext, "ps")) {
+    if (external_exists("epstopdf"))
+      return "epstopdf --outfile=\"%1$s\" \"%2$s\"";
+  } else if (STR_EQU(ext, "svg")) {
+    if (external_exists("rsvg-convert"))
+      return "rsvg-convert -f pdf -o \"%1$s\" \"%2$s\"";
+    if (external_exists("inkscape"))
+      return "inkscape --export-type=pdf --export-filename=\"%1$s\" "
+             "\"%2$s\"";
+  }
+  return NULL;
+}
+
+static gboolean graphics_resolve(const gchar* curdir, const gchar* name,
+                                 gchar** source, gchar** target)
+{
+  const gchar* convertible[] = { "eps", "ps", "svg", NULL };
+  /* what graphicx tries before it would get to an .eps */
+  const gchar* native[] = { "pdf", "png", "jpg", "jpeg", "mps", "PDF", "PNG",
+                            "JPG", "JPEG", NULL };
+  const gchar* ext = strrchr(name, '.');
+  gint i = 0;
+
+  /* TeX only looks up relative names in its search path */
+  if (g_path_is_absolute(name)) return FALSE;
+
+  if (ext && !strchr(ext, G_DIR_SEPARATOR)) {
+    /* with an explicit extension, provide the file epstopdf looks for */
+    for (i = 0; convertible[i] && !STR_EQU(ext + 1, convertible[i]); ++i);
+    if (!convertible[i]) return FALSE;
+    *source = g_build_filename(curdir, name, NULL);
+    *target = g_strdup_printf("%.*s-%s-converted-to.pdf",
+                              (gint)(ext - name), name, ext + 1);
+    return utils_path_exists(*source);
+  }
+
+  /* without one, graphicx takes a .pdf of that name before anything else
+   * that can be converted */
+  for (i = 0; native[i]; ++i) {
+    gchar* path = g_strdup_printf("%s%c%s.%s", curdir, G_DIR_SEPARATOR,
+                                  name, native[i]);
+    gboolean exists = utils_path_exists(path);
+    g_free(path);
+    if (exists) return FALSE;
+  }
+  for (i = 0; convertible[i]; ++i) {
+    *source = g_strdup_printf("%s%c%s.%s", curdir, G_DIR_SEPARATOR,
+                              name, convertible[i]);
+    if (utils_path_exists(*source)) {
+      *target = g_strdup_printf("%s.pdf", name);
+      return TRUE;
+    }
+    g_free(*source);
+    *source = NULL;
+  }
+  return FALSE;
+}
+
+static gboolean graphics_resolve_raster(const gchar* curdir,
+                                        const gchar* name, gchar** source,
+                                        gchar** target)
+{
+  const gchar* raster[] = { "png", "jpg", "jpeg", "PNG", "JPG", "JPEG",
+                            NULL };
+  /* the order graphicx tries extensions in */
+  const gchar* native[] = { "pdf", "png", "jpg", "mps", "jpeg", "PDF", "PNG",
+                            "JPG", "JPEG", NULL };
+  const gchar* ext = strrchr(name, '.');
+  gint i = 0;
+
+  if (g_path_is_absolute(name)) return FALSE;
+
+  if (ext && !strchr(ext, G_DIR_SEPARATOR)) {
+    for (i = 0; raster[i] && !STR_EQU(ext + 1, raster[i]); ++i);
+    if (!raster[i]) return FALSE;
+    *source = g_build_filename(curdir, name, NULL);
+    *target = g_strdup(name);
+    return utils_path_exists(*source);
+  }
+
+  /* the proxy shadows the file graphicx would pick without one */
+  for (i = 0; native[i]; ++i) {
+    *source = g_strdup_printf("%s%c%s.%s", curdir, G_DIR_SEPARATOR,
+                              name, native[i]);
+    if (utils_path_exists(*source)) break;
+    g_free(*source);
+    *source = NULL;
+  }
+  if (!*source) return FALSE;
+
+  ext = strrchr(*source, '.') + 1;
+  for (i = 0; raster[i] && !STR_EQU(ext, raster[i]); ++i);
+  if (!raster[i]) {
+    g_free(*source);
+    *source = NULL;
+    return FALSE;
+  }
+  *target = g_strdup_printf("%s.%s", name, ext);
+  return TRUE;
+}
+
+void graphics_update(GuGraphics* gc, GuEditor* ec, const gchar* text,
+                     gboolean proxies)
+{
+  GError* err = NULL;
+  GRegex* match_str = NULL;
+  GMatchInfo* match_info = NULL;
+  guint hits = gc->cache->hits;
+  guint misses = gc->cache->misses;
+
+  if (!(match_str = g_regex_new(INCLUDEGRAPHICS, 0, 0, &err))) {
+    slog(L_ERROR, "g_regex_new (): %s\n", err->message);
+    g_error_free(err);
+    return;
+  }
+
+  GHashTable* used = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, NULL);
+  GHashTable* converted = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free, NULL);
+  gboolean convert = graphics_cache_active();
+  gchar* curdir = editor_get_compile_dir(ec);
+  g_regex_match(match_str, text, 0, &match_info);
+  while (g_match_info_matches(match_info)) {
+    gchar* name = g_match_info_fetch(match_info, 1);
+    gchar* source = NULL;
+    gchar* target = NULL;
+    const gchar* converter = NULL;
+    gchar* cached = NULL;
+
+    if (convert && graphics_resolve(curdir, name, &source, &target) &&
+        (converter = graphics_get_converter(strrchr(source, '.') + 1)) &&
+        (cached = graphics_convert(gc, source, converter))) {
+      gchar* dest = g_build_filename(gc->dir, target, NULL);
+      graphics_publish(cached, dest);
+      g_hash_table_insert(converted, target, NULL);
+      target = NULL;
+      g_free(dest);
+      g_free(cached);
+    }
+    g_free(source);
+    g_free(target);
+    source = target = cached = NULL;
+
+    if (proxies && graphics_resolve_raster(curdir, name, &source, &target) &&
+        (cached = graphics_make_proxy(gc, source))) {
+      gchar* dest = g_build_filename(gc->proxydir, target, NULL);
+      graphics_publish(cached, dest);
+      g_hash_table_insert(used, target, NULL);
+      target = NULL;
+      g_free(dest);
+      g_free(cached);
+    }
+
+    g_free(source);
+    g_free(target);
+    g_free(name);
+    g_match_info_next(match_info, NULL);
+  }
+  g_match_info_free(match_info);
+  g_regex_unref(match_str);
+  g_free(curdir);
+
+  /* conversions of graphics that are gone, or that another document
+   * included. Left behind they would shadow files of the same name */
+  GHashTableIter iter;
+  gpointer target = NULL;
+  g_hash_table_iter_init(&iter, gc->converted);
+  while (g_hash_table_iter_next(&iter, &target, NULL)) {
+    if (!g_hash_table_contains(converted, target)) {
+      gchar* dest = g_build_filename(gc->dir, (gchar*)target, NULL);
+      g_remove(dest);
+      g_free(dest);
+    }
+  }
+  g_hash_table_unref(gc->converted);
+  gc->converted = converted;
+
+  /* proxies of images that are gone, or of a full resolution build */
+  g_hash_table_iter_init(&iter, gc->proxies);
+  while (g_hash_table_iter_next(&iter, &target, NULL)) {
+    if (!g_hash_table_contains(used, target)) {
+      gchar* dest = g_build_filename(gc->proxydir, (gchar*)target, NULL);
+      g_remove(dest);
+      g_free(dest);
+    }
+  }
+  g_hash_table_unref(gc->proxies);
+  gc->proxies = used;
+
+  if (gc->cache->misses != misses) {
+    cache_evict(gc->cache,
+                (goffset)atoi(config_get_value("graphics_cache_size")) << 20);
+  }
+  gc->hits = gc->cache->hits - hits;
+  gc->misses = gc->cache->misses - misses;
+  if (gc->hits || gc->misses) {
+    slog(L_DEBUG, "Graphics cache: %u hits, %u misses\n",
+         gc->cache->hits, gc->cache->misses);
+  }
+}
+
+gboolean graphics_needs_conversion(GuEditor* ec, const gchar* text)
+{
+  GError* err = NULL;
+  GRegex* match_str = NULL;
+  GMatchInfo* match_info = NULL;
+  gboolean needed = FALSE;
+
+  if (!graphics_cache_active()) return FALSE;
+  if (!(match_str = g_regex_new(INCLUDEGRAPHICS, 0, 0, &err))) {
+    slog(L_ERROR, "g_regex_new (): %s\n", err->message);
+    g_error_free(err);
+    return FALSE;
+  }
+
+  gchar* curdir = editor_get_compile_dir(ec);
+  g_regex_match(match_str, text, 0, &match_info);
+  while (!needed && g_match_info_matches(match_info)) {
+    gchar* name = g_match_info_fetch(match_info, 1);
+    gchar* source = NULL;
+    gchar* target = NULL;
+
+    needed = graphics_resolve(curdir, name, &source, &target) &&
+             graphics_get_converter(strrchr(source, '.') + 1);
+    g_free(source);
+    g_free(target);
+    g_free(name);
+    g_match_info_next(match_info, NULL);
+  }
+  g_match_info_free(match_info);
+  g_regex_unref(match_str);
+  g_free(curdir);
+  return needed;
+}
+
+static gchar* graphics_convert(GuGraphics* gc, const gchar* source,
+                               const gchar* converter)
+{
+  GStatBuf st;
+  gchar* contents = NULL;
+  gsize length = 0;
+  gchar* hash = NULL;
+  gchar* key = NULL;
+  gchar* entry = NULL;
+  gchar* cached = NULL;
+
+  if (g_stat(source, &st) != 0) return NULL;
+
+  /* only read a graphic again once its size or mtime changed */
+  gchar* stamp = g_strdup_printf("%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT
+                                 ":", (gint64)st.st_size,
+                                 (gint64)st.st_mtime);
+  const gchar* known = g_hash_table_lookup(gc->checksums, source);
+  if (known && g_str_has_prefix(known, stamp)) {
+    hash = g_strdup(known + strlen(stamp));
+  } else {
+    if (!g_file_get_contents(source, &contents, &length, NULL)) {
+      g_free(stamp);
+      return NULL;
+    }
+    hash = g_compute_checksum_for_data(G_CHECKSUM_MD5, (guchar*)contents,
+                                       length);
+    g_free(contents);
+    g_hash_table_insert(gc->checksums, g_strdup(source),
+                        g_strconcat(stamp, hash, NULL));
+  }
+  g_free(stamp);
+
+  /* the converter is part of the key, its output differs between tools */
+  key = cache_get_key(hash, converter, NULL);
+  if (!(entry = cache_lookup(gc->cache, key))) {
+    gchar* output = g_build_filename(C_TMPDIR, "graphics-" CONVERTED_NAME,
+                                     NULL);
+    gchar* command = g_strdup_printf(converter, output, source);
+
+    slog(L_DEBUG, "Converting %s\n", source);
+    Tuple2 res = utils_popen_r(command, NULL);
+    if ((glong)res.first == 0 && utils_path_exists(output) &&
+        cache_store_file(gc->cache, key, CONVERTED_NAME, output)) {
+      entry = g_build_filename(gc->cache->dir, key, NULL);
+    } else {
+      slog(L_WARNING, "Could not convert %s\n", source);
+    }
+    g_remove(output);
+    g_free(res.second);
+    g_free(command);
+    g_free(output);
+  }
+
+  if (entry) {
+    cached = g_build_filename(entry, CONVERTED_NAME, NULL);
+    /* epstopdf only reuses a conversion that is newer than its source */
+    g_utime(cached, NULL);
+  }
+  g_free(entry);
+  g_free(key);
+  g_free(hash);
+  return cached;
+}
+
+static void graphics_publish(const gchar* cached, const gchar* dest)
+{
+  gchar* dir = g_path_get_dirname(dest);
+  GError* err = NULL;
+
+  g_mkdir_with_parents(dir, DIR_PERMS);
+  g_remove(dest);
+#ifndef WIN32
+  if (symlink(cached, dest) == 0) {
+    g_free(dir);
+    return;
+  }
+#endif
+  if (!utils_copy_file(cached, dest, &err)) {
+    slog(L_ERROR, "Could not provide %s: %s\n", dest, err->message);
+    g_error_free(err);
+  }
+  g_free(dir);
+}
+
+static gboolean graphics_get_proxy_command(const gchar* source,
+                                           const gchar* output,
+                                           gint maxsize, gchar** command)
+{
+  const gchar* resizer = graphics_get_resizer();
+  gint width = 0, height = 0;
+  gdouble xres = 0, yres = 0;
+  gchar units[32] = { 0 };
+
+  gchar* identify = g_strdup_printf("%s -format \"%%w %%h "
+                                    "%%[resolution.x] %%[resolution.y] "
+                                    "%%[units]\" \"%s[0]\"",
+                                    STR_EQU(resizer, "magick") ?
+                                      "magick identify" : "identify",
+                                    source);
+  Tuple2 res = utils_popen_r(identify, NULL);
+  g_free(identify);
+  if ((glong)res.first != 0 || !res.second ||
+      sscanf((gchar*)res.second, "%d %d %lf %lf %31s", &width, &height,
+             &xres, &yres, units) < 4) {
+    slog(L_WARNING, "Could not identify %s\n", source);
+    g_free(res.second);
+    return FALSE;
+  }
+  g_free(res.second);
+
+  if (MAX(width, height) <= maxsize) return TRUE;
+
+  /* TeX takes the size of an image from its resolution, which has to
+   * shrink along with the pixels. Without one it assumes 72 dpi */
+  if (STR_EQU(units, "PixelsPerCentimeter")) {
+    xres *= 2.54;
+    yres *= 2.54;
+  } else if (!STR_EQU(units, "PixelsPerInch") || xres <= 0 || yres <= 0) {
+    xres = yres = 72;
+  }
+  gdouble scale = (gdouble)maxsize / MAX(width, height);
+
+  *command = g_strdup_printf("%s \"%s[0]\" -resize %dx%d! "
+                             "-units PixelsPerInch -density %.4fx%.4f "
+                             "-quality 90 \"%s\"", resizer, source,
+                             MAX(1, (gint)(width * scale + 0.5)),
+                             MAX(1, (gint)(height * scale + 0.5)),
+                             xres * scale, yres * scale, output);
+  return TRUE;
+}
+
+static gchar* graphics_make_proxy(GuGraphics* gc, const gchar* source)
+{
+  GStatBuf st;
+  gint maxsize = atoi(config_get_value("image_proxy_size"));
+  const gchar* ext = strrchr(source, '.') + 1;
+  gchar* entry = NULL;
+  gchar* cached = NULL;
+
+  if (maxsize <= 0 || g_stat(source, &st) != 0) return NULL;
+  if (st.st_size < PROXY_MIN_SIZE) return NULL;
+
+  /* Reading a large image is what the proxy is there to avoid, so it is
+   * keyed by the file and its size and mtime instead of its contents */
+  gchar* stamp = g_strdup_printf("%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT
+                                 ":%d", (gint64)st.st_size,
+                                 (gint64)st.st_mtime, maxsize);
+  gchar* key = cache_get_key("proxy", source, stamp, NULL);
+  gchar* name = g_strdup_printf("proxy.%s", ext);
+
+  if (!(entry = cache_lookup(gc->cache, key))) {
+    gchar* output = g_strdup_printf("%s%cgraphics-%s", C_TMPDIR,
+                                    G_DIR_SEPARATOR, name);
+    gchar* command = NULL;
+
+    if (graphics_get_proxy_command(source, output, maxsize, &command)) {
+      if (!command) {
+        /* small enough already, remember not to look at it again */
+        cache_store_contents(gc->cache, key, UNSCALED_NAME, "");
+      } else {
+        slog(L_DEBUG, "Downsampling %s\n", source);
+        Tuple2 res = utils_popen_r(command, NULL);
+        if ((glong)res.first == 0 && utils_path_exists(output) &&
+            cache_store_file(gc->cache, key, name, output)) {
+          entry = g_build_filename(gc->cache->dir, key, NULL);
+        } else {
+          slog(L_WARNING, "Could not downsample %s\n", source);
+        }
+        g_free(res.second);
+      }
+    }
+    g_remove(output);
+    g_free(command);
+    g_free(output);
+  }
+
+  if (entry) {
+    cached = g_build_filename(entry, name, NULL);
+    if (!utils_path_exists(cached)) {
+      g_free(cached);
+      cached = NULL;
+    }
+  }
+  g_free(entry);
+  g_free(name);
+  g_free(key);
+  g_free(stamp);
+  return cached;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file   graphics.h
+ * @brief  conversion of graphics TeX can't include directly
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GUMMI_GRAPHICS_H__
+#define __GUMMI_GRAPHICS_H__
+
+#include <glib.h>
+
+#include "cache.h"
+#include "editor.h"
+
+/**
+ * GuGraphics:
+ * @cache: converted graphics keyed by the checksum of their source
+ * @dir: directory searched by TeX that holds the converted graphics of
+ *       the document being compiled
+ * @converted: names of the converted graphics in dir
+ * @checksums: checksums of the converted sources, keyed by their path and
+ *             remembered along with their size and mtime
+ * @proxydir: directory searched by TeX before anything else that holds
+ *            the image proxies of the document being compiled
+ * @proxies: names of the image proxies in proxydir
+ * @hits: graphics the last update took from the cache
+ * @misses: graphics the last update had to convert
+ *
+ * EPS and SVG graphics are converted to PDF by Gummi ahead of the compile.
+ * The conversions outlive the session in the user cache directory, so an
+ * unchanged graphic is only ever converted once.
+ *
+ * Preview compiles may also replace large PNG and JPEG images by copies
+ * downsampled to screen resolution, the proxies. They keep the physical
+ * size of their image, so the layout does not change.
+ */
+#define GU_GRAPHICS(x) ((GuGraphics*)x)
+typedef struct _GuGraphics GuGraphics;
+
+struct _GuGraphics {
+  GuCache* cache;
+  gchar* dir;
+  GHashTable* converted;
+  GHashTable* checksums;
+  gchar* proxydir;
+  GHashTable* proxies;
+  guint hits;
+  guint misses;
+};
+
+GuGraphics* graphics_init(void);
+gboolean graphics_cache_active(void);
+gboolean graphics_proxies_active(void);
+
+/**
+ * graphics_update:
+ *
+ * Converts the graphics included by text that need converting, taking them
+ * from the cache where possible, and makes them available in dir. Anything
+ * in dir that text no longer includes is removed again. With
+ * proxies set, the proxies of large raster images are made available in
+ * proxydir as well, otherwise proxydir is emptied.
+ */
+void graphics_update(GuGraphics* gc, GuEditor* ec, const gchar* text,
+                     gboolean proxies);
+
+/**
+ * graphics_needs_conversion:
+ *
+ * Returns: TRUE if text includes graphics that graphics_update converts,
+ * TeX can not read them without it.
+ */
+gboolean graphics_needs_conversion(GuEditor* ec, const gchar* text);
+
+#endif /* __GUMMI_GRAPHICS_H__ */
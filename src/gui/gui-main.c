@@ -45,6 +45,7 @@
 #include "editor.h"
 #include "environment.h"
 #include "importer.h"
+#include "logparser.h"
 #include "utils.h"
 #include "template.h"
 
@@ -224,11 +225,7 @@ GummiGui* gui_init(GtkBuilder* builder)
   g->menu_autosync =
     GTK_CHECK_MENU_ITEM(gtk_builder_get_object(builder, "menu_autosync"));
 
-  if (latex_can_synctex() && config_get_value("synctex")) {
-    gtk_widget_set_sensitive(GTK_WIDGET(g->menu_autosync), TRUE);
-    gboolean async = latex_use_synctex();
-    gtk_check_menu_item_set_active(g->menu_autosync, (async ? TRUE : FALSE));
-  }
+  gui_set_synctex_sensitivity(g);
 
   if (!config_get_value("compile_status"))
     gtk_toggle_tool_button_set_active(g->previewoff, TRUE);
@@ -309,9 +306,9 @@ G_MODULE_EXPORT
 void on_tab_notebook_switch_page(GtkNotebook *notebook, GtkWidget *nbpage,
                                  int pagenr, void *data)
 {
+  GuEditor* previous = g_active_editor;
+
   slog(L_DEBUG, "Switched to environment at page %d\n", pagenr);
-  /* Kill typesetter command */
-  motion_kill_typesetter(gummi->motion);
 
   /* set the active tab/editor pointers */
   tabmanager_set_active_tab(pagenr);
@@ -322,6 +319,11 @@ void on_tab_notebook_switch_page(GtkNotebook *notebook, GtkWidget *nbpage,
   /* clear the build log output window */
   gui_buildlog_set_text("");
 
+  /* The tab that was left is finished in the background, the compile
+   * for the new one takes over the foreground */
+  if (previous && previous != g_active_editor)
+    motion_queue_background(gummi->motion, previous);
+
   previewgui_reset(gui->previewgui);
 }
 
@@ -485,10 +487,25 @@ gboolean on_mainwindow_window_state_event(GtkWidget *widget, GdkEvent* event,
   return FALSE;
 }
 
+static void on_bibliography_compiled(guint ran, const gchar* output,
+                                     gpointer user)
+{
+  if (biblio_bibliography_compiled(gummi->biblio, ran, output)) {
+    statusbar_set_message(_("Compiling bibliography file..."));
+    gtk_progress_bar_set_text(gummi->biblio->progressbar,
+                              _("Bibliography compiled without errors"));
+  } else {
+    statusbar_set_message
+    (_("Error compiling bibliography file or none detected..."));
+    gtk_progress_bar_set_text(gummi->biblio->progressbar,
+                              _("Error compiling bibliography file"));
+  }
+}
+
 G_MODULE_EXPORT
 void on_menu_bibupdate_activate(GtkWidget *widget, void * user)
 {
-  biblio_compile_bibliography(gummi->biblio, g_active_editor, gummi->latex);
+  biblio_compile_bibliography(gummi->biblio, on_bibliography_compiled, NULL);
 }
 
 G_MODULE_EXPORT
@@ -638,18 +655,10 @@ void on_button_biblio_compile_clicked(GtkWidget* widget, void* user)
   gtk_widget_set_sensitive(widget, FALSE);
   g_timeout_add(10, on_bibprogressbar_update, NULL);
 
-  if (biblio_compile_bibliography(gummi->biblio, g_active_editor,
-                                  gummi->latex)) {
-    statusbar_set_message(_("Compiling bibliography file..."));
-    gtk_progress_bar_set_text(gummi->biblio->progressbar,
-                              _("Bibliography compiled without errors"));
-    motion_force_compile(gummi->motion);
-  } else {
-    statusbar_set_message
-    (_("Error compiling bibliography file or none detected..."));
-    gtk_progress_bar_set_text(gummi->biblio->progressbar,
-                              _("Error compiling bibliography file"));
-  }
+  /* the compile that follows bibtex on the compile thread shows it */
+  if (!biblio_compile_bibliography(gummi->biblio, on_bibliography_compiled,
+                                   NULL))
+    on_bibliography_compiled(0, "", NULL);
 }
 
 G_MODULE_EXPORT
@@ -751,6 +760,16 @@ void on_biblio_filter_changed(GtkWidget* widget, void* user)
   g_object_unref(G_OBJECT(filter));
 }
 
+void gui_set_synctex_sensitivity(GummiGui* g)
+{
+  /* called again once the texlive version has been probed */
+  if (latex_can_synctex() && config_get_value("synctex")) {
+    gtk_widget_set_sensitive(GTK_WIDGET(g->menu_autosync), TRUE);
+    gboolean async = latex_use_synctex();
+    gtk_check_menu_item_set_active(g->menu_autosync, (async ? TRUE : FALSE));
+  }
+}
+
 void typesetter_setup(void)
 {
   // change the pref gui options on changing typesetter:
@@ -1032,6 +1051,35 @@ void gui_buildlog_set_text(const gchar *message)
   }
 }
 
+void gui_buildlog_set_log(GSList* entries, const gchar* log)
+{
+  GString* text = g_string_new("");
+  GSList* iter = NULL;
+  gsize len = log ? strlen(log) : 0;
+
+  /* diagnostics first, they are what the user is looking for */
+  for (iter = entries; iter; iter = iter->next) {
+    gchar* line = logparser_format_entry(GU_LOG_ENTRY(iter->data));
+    g_string_append_printf(text, "%s\n", line);
+    g_free(line);
+  }
+  if (entries) g_string_append_c(text, '\n');
+
+  /* rendering megabytes of package loading messages takes ages, only
+   * show the tail of huge logs */
+  if (len > BUILDLOG_MAX_SIZE) {
+    const gchar* tail = g_utf8_find_next_char(log + len - BUILDLOG_MAX_SIZE,
+                                              NULL);
+    g_string_append(text, "[...]\n");
+    g_string_append(text, tail ? tail : "");
+  } else if (log) {
+    g_string_append(text, log);
+  }
+
+  gui_buildlog_set_text(text->str);
+  g_string_free(text, TRUE);
+}
+
 void statusbar_set_message(const gchar *message)
 {
   gtk_statusbar_push(GTK_STATUSBAR(gui->statusbar), gui->statusid, message);
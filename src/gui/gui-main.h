@@ -46,6 +46,7 @@
 
 #define RECENT_FILES_NUM 5
 #define TEXCOUNT_OUTPUT_LINES 7
+#define BUILDLOG_MAX_SIZE (256 * 1024)
 
 /* These macros should be only used in GUI related classes
  * which acted as syntax sugar */
@@ -170,9 +171,11 @@ void add_to_recent_list(const gchar* filename);
 void display_recent_files(GummiGui* gui);
 
 void gui_buildlog_set_text(const gchar *message);
+void gui_buildlog_set_log(GSList* entries, const gchar* log);
 void statusbar_set_message(const gchar* message);
 gboolean statusbar_del_message(void* user);
 
+void gui_set_synctex_sensitivity(GummiGui* g);
 void typesetter_setup(void);
 
 void check_preview_timer(void);
@@ -29,6 +29,8 @@
 
 #include "gui-menu.h"
 
+#include <glib/gstdio.h>
+
 #include "configfile.h"
 #include "constants.h"
 #include "editor.h"
@@ -37,6 +39,7 @@
 #include "gui-main.h"
 #include "gui-preview.h"
 #include "motion.h"
+#include "process.h"
 #include "project.h"
 
 extern Gummi* gummi;
@@ -450,8 +453,8 @@ void on_menu_findprev_activate(GtkWidget *widget, void *user)
 G_MODULE_EXPORT
 void on_menu_pdfcompile_activate(GtkWidget *widget, void* user)
 {
-  gummi->latex->modified_since_compile = TRUE;
-  motion_do_compile(gummi->motion);
+  /* an explicit compile builds projects with all their chapters */
+  motion_force_compile(gummi->motion);
 }
 
 G_MODULE_EXPORT
@@ -472,15 +475,19 @@ void on_menu_cleanup_activate(GtkWidget *widget, void *user)
   }
 }
 
+static void on_makeindex_finished(guint ran, const gchar* output,
+                                  gpointer user)
+{
+  if (!(ran & AUX_MAKEINDEX))
+    statusbar_set_message(_("Error running Makeindex.."));
+}
+
 G_MODULE_EXPORT
 void on_menu_runmakeindex_activate(GtkWidget *widget, void *user)
 {
-  if (latex_run_makeindex(g_active_editor)) {
-    statusbar_set_message(_("Running Makeindex.."));
-  } else {
-    statusbar_set_message(_("Error running Makeindex.."));
-  }
-  motion_force_compile(gummi->motion);
+  statusbar_set_message(_("Running Makeindex.."));
+  motion_run_auxtools(gummi->motion, AUX_MAKEINDEX, on_makeindex_finished,
+                      NULL);
 }
 
 G_MODULE_EXPORT
@@ -489,18 +496,16 @@ void on_menu_runbibtex_activate(GtkWidget *widget, void *user)
   on_button_biblio_compile_clicked(widget, user);
 }
 
-G_MODULE_EXPORT
-void on_menu_docstat_activate(GtkWidget *widget, void *user)
+static void on_texcount_finished(gint status, const gchar* output,
+                                 gpointer user)
 {
   gint i = 0;
-  gchar* output = 0;
-  gchar* cmd = 0;
   gchar** matched = NULL;
   GError* err = NULL;
   GMatchInfo* match_info;
-  GRegex* regexs[TEXCOUNT_OUTPUT_LINES];
+  GRegex* regex = NULL;
   gchar* res[TEXCOUNT_OUTPUT_LINES] = { 0 };
-
+  gchar* tmpfile = (gchar*)user;
 
   /* TODO: can we deprecate this? */
   const gchar* terms[] = {
@@ -523,49 +528,30 @@ void on_menu_docstat_activate(GtkWidget *widget, void *user)
     "Number of math displayed: ([0-9]*)"
   };
 
+  g_remove(tmpfile);
+  g_free(tmpfile);
 
-  /* TODO: move to non gui class (latex perhaps) */
-  if (external_exists("texcount")) {
-    /* Copy workfile to /tmp to remove any spaces in filename to avoid
-     * segfaults */
-    gchar* tmpfile = g_strdup_printf("%s.state", g_active_editor->fdname);
-    if (!utils_copy_file(g_active_editor->workfile, tmpfile, &err)) {
-      slog(L_G_ERROR, "utils_copy_file (): %s\n", err->message);
-      g_free(tmpfile);
+  /* the document may have been closed while texcount was running */
+  if (!g_active_tab || !output) return;
+
+  for (i = 0; i < TEXCOUNT_OUTPUT_LINES; ++i) {
+    if (!(regex = g_regex_new(terms_regex[i], 0, 0, &err))) {
+      slog(L_G_ERROR, "g_regex_new (): %s\n", err->message);
       g_error_free(err);
       goto cleanup;
     }
-
-    cmd = g_strdup_printf("texcount '%s'", tmpfile);
-    Tuple2 result = utils_popen_r(cmd, NULL);
-
-    for (i = 0; i < TEXCOUNT_OUTPUT_LINES; ++i)
-      if (!(regexs[i] = g_regex_new(terms_regex[i], 0, 0, &err))) {
-        slog(L_G_ERROR, "utils_copy_file (): %s\n", err->message);
-        g_free(tmpfile);
-        g_error_free(err);
-        goto cleanup;
-      }
-
-    for (i = 0; i < TEXCOUNT_OUTPUT_LINES; ++i) {
-      if (g_regex_match(regexs[i], result.second, 0, &match_info)) {
-        matched = g_match_info_fetch_all(match_info);
-        if (NULL == matched[1]) {
-          slog(L_WARNING, "can't extract info: %s\n", terms[i]);
-          res[i] = g_strdup("N/A");
-        } else {
-          res[i] = g_strdup(matched[1]);
-        }
-        g_strfreev(matched);
-        g_match_info_free(match_info);
+    if (g_regex_match(regex, output, 0, &match_info)) {
+      matched = g_match_info_fetch_all(match_info);
+      if (NULL == matched[1]) {
+        slog(L_WARNING, "can't extract info: %s\n", terms[i]);
+        res[i] = g_strdup("N/A");
+      } else {
+        res[i] = g_strdup(matched[1]);
       }
+      g_strfreev(matched);
     }
-    g_free(result.second);
-    g_free(tmpfile);
-  } else {
-    cmd = NULL;
-    slog(L_G_ERROR, "The 'texcount' utility could not be found.\n");
-    return;
+    g_match_info_free(match_info);
+    g_regex_unref(regex);
   }
 
   gchararray items[6] = {"stats_words", "stats_head", "stats_float",
@@ -584,15 +570,45 @@ void on_menu_docstat_activate(GtkWidget *widget, void *user)
   gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(gui->builder,
                                "stats_filename")), tabmanagergui_get_labeltext(g_active_tab->page));
   gtk_widget_show(gui->docstatswindow);
-  return;
 
 cleanup:
-  for (i = 0; i < TEXCOUNT_OUTPUT_LINES; ++i) {
-    g_regex_unref(regexs[i]);
+  for (i = 0; i < TEXCOUNT_OUTPUT_LINES; ++i)
     g_free(res[i]);
+}
+
+G_MODULE_EXPORT
+void on_menu_docstat_activate(GtkWidget *widget, void *user)
+{
+  gchar* cmd = 0;
+  GError* err = NULL;
+  GuProcess* proc = NULL;
+
+  /* TODO: move to non gui class (latex perhaps) */
+  if (external_exists("texcount")) {
+    /* Copy workfile to /tmp to remove any spaces in filename to avoid
+     * segfaults */
+    gchar* tmpfile = g_strdup_printf("%s.state", g_active_editor->fdname);
+    if (!utils_copy_file(g_active_editor->workfile, tmpfile, &err)) {
+      slog(L_G_ERROR, "utils_copy_file (): %s\n", err->message);
+      g_free(tmpfile);
+      g_error_free(err);
+      return;
+    }
+
+    /* counting words in a big document takes a while, don't block the
+     * interface on it */
+    cmd = g_strdup_printf("texcount '%s'", tmpfile);
+    if (!(proc = process_spawn(cmd, NULL, &err))) {
+      slog(L_G_ERROR, "%s\n", err->message);
+      g_error_free(err);
+      g_free(tmpfile);
+    } else {
+      process_watch(proc, on_texcount_finished, tmpfile);
+    }
+    g_free(cmd);
+  } else {
+    slog(L_G_ERROR, "The 'texcount' utility could not be found.\n");
   }
-  g_free(cmd);
-  g_free(output);
 }
 
 G_MODULE_EXPORT
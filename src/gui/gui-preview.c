@@ -34,6 +34,7 @@
 #include <string.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
 #include <cairo.h>
@@ -47,6 +48,7 @@
 
 #include "motion.h"
 #include "porting.h"
+#include "project.h"
 
 #include "syncTeX/synctex_parser.h"
 
@@ -92,8 +94,10 @@ typedef struct {
 } SyncNode;
 
 
-static void on_document_compiled(GObject* hook, GuEditor* editor);
+static void on_document_compiled(GObject* hook, GuCompileJob* job);
 static void on_document_error(GObject* hook, const gchar* error_text);
+static void on_document_focused(GObject* hook, GuEditor* editor);
+static void on_document_progress(GObject* hook, GuCompileProgress* progress);
 static void previewgui_set_scale(GuPreviewGui* pc, gdouble scale, gdouble x,
                                  gdouble y);
 
@@ -139,6 +143,7 @@ static void paint_page(cairo_t *cr, GuPreviewGui* pc,
                        gint page, gint x, gint y);
 static cairo_surface_t* get_page_rendering(GuPreviewGui* pc, int page);
 static gboolean remove_page_rendering(GuPreviewGui* pc, gint page);
+static void previewgui_state_free(gpointer data);
 
 /* Functions for scronizing editor and preview via SyncTeX */
 static gboolean synctex_run_parser(GuPreviewGui* pc, GtkTextIter *sync_to,
@@ -174,6 +179,10 @@ GuPreviewGui* previewgui_init(GtkBuilder * builder)
                    G_CALLBACK(on_document_compiled), NULL);
   g_signal_connect(p->sig_hook, "document-error",
                    G_CALLBACK(on_document_error), NULL);
+  g_signal_connect(p->sig_hook, "document-focused",
+                   G_CALLBACK(on_document_focused), NULL);
+  g_signal_connect(p->sig_hook, "document-progress",
+                   G_CALLBACK(on_document_progress), NULL);
 
   GdkRGBA bg = {0.90, 0.90, 0.90, 1.0};
   p->previewgui_viewport =
@@ -182,6 +191,8 @@ GuPreviewGui* previewgui_init(GtkBuilder * builder)
     GTK_WIDGET(gtk_builder_get_object(builder, "previewgui_toolbar"));
   p->statuslight =
     GTK_WIDGET(gtk_builder_get_object(builder, "tool_statuslight"));
+  p->progress =
+    GTK_WIDGET(gtk_builder_get_object(builder, "compile_progress"));
   p->drawarea =
     GTK_WIDGET(gtk_builder_get_object(builder, "preview_draw"));
   p->scrollw =
@@ -299,6 +310,11 @@ GuPreviewGui* previewgui_init(GtkBuilder * builder)
 
   p->sync_nodes = NULL;
 
+  p->owner = NULL;
+  p->states = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                    previewgui_state_free);
+  p->parked_size = 0;
+
   slog(L_INFO, "using libpoppler %s\n", poppler_get_version());
   return p;
 }
@@ -328,40 +344,95 @@ void previewgui_stop_errormode(GuPreviewGui *pc)
   pc->errormode = FALSE;
 }
 
-static void on_document_compiled(GObject* hook, GuEditor* editor)
+static void on_document_compiled(GObject* hook, GuCompileJob* job)
 {
-  GuLatex* latex = gummi_get_latex();
   GuPreviewGui* pc = gui->previewgui;
+  GuEditor* editor = job->editor;
 
-  previewgui_update_statuslight(latex->compile_status ? "gtk-yes" : "gtk-no");
+  previewgui_update_statuslight(job->compile_status ? "gtk-yes" : "gtk-no");
 
   /* Make sure the editor still exists after compile */
   if (editor == gummi_get_active_editor()) {
-    editor_apply_errortags(editor, latex->errorlines);
-    gui_buildlog_set_text(latex->compilelog);
+    /* project members show the output of the root document */
+    GuEditor* root = job->root;
+
+    editor_apply_errortags(editor, job->entries);
+    gui_buildlog_set_log(job->entries, job->compilelog);
 
-    if (latex->errorlines[0]) {
+    if (!job->compile_status) {
       previewgui_start_errormode(pc, "compile_error");
     } else {
+      gchar* uri = g_strconcat(urifrmt, root ? root->pdffile
+                                             : editor->pdffile, NULL);
       if (!pc->uri) {
-        gchar* uri = g_strconcat(urifrmt, editor->pdffile, NULL);
         previewgui_set_pdffile(pc, uri);
-        g_free(uri);
       } else {
+        /* The full document takes over from the focus preview */
+        if (!STR_EQU(pc->uri, uri)) {
+          g_free(pc->uri);
+          pc->uri = g_strdup(uri);
+        }
         previewgui_refresh(gui->previewgui,
             editor->sync_to_last_edit ?
-            & (editor->last_edit) : NULL, editor->workfile);
+            & (editor->last_edit) : NULL,
+            root ? editor->filename : editor->workfile);
       }
+      g_free(uri);
       if (pc->errormode) previewgui_stop_errormode(pc);
     }
   }
 }
 
+static void on_document_focused(GObject* hook, GuEditor* editor)
+{
+  GuPreviewGui* pc = gui->previewgui;
+
+  /* The focus preview is only shown until the full compile of the same
+   * editor finishes, errors are left for that one to report */
+  if (editor == gummi_get_active_editor() && !pc->errormode) {
+    gchar* uri = g_strconcat(urifrmt, editor->focuspdf, NULL);
+    g_free(pc->uri);
+    pc->uri = NULL;
+    previewgui_set_pdffile(pc, uri);
+    g_free(uri);
+  }
+}
+
 static void on_document_error(GObject* hook, const gchar* error_text)
 {
   previewgui_start_errormode(gui->previewgui, error_text);
 }
 
+static void on_document_progress(GObject* hook, GuCompileProgress* progress)
+{
+  GuPreviewGui* pc = gui->previewgui;
+  gchar* text = NULL;
+  gchar* tooltip = NULL;
+
+  if (progress->finished) {
+    text = g_strdup_printf(_("%u pages, %.1fs"), progress->pages,
+                           progress->elapsed);
+    tooltip = g_strdup_printf(_("Time to first page: %.2fs\n"
+                                "Converted graphics: %u reused, %u converted"),
+                              progress->first_page, progress->graphics_hits,
+                              progress->graphics_misses);
+  } else if (progress->previous > 0) {
+    text = g_strdup_printf("%s [%u] %.1fs / %.1fs",
+                           progress->file ? progress->file : "",
+                           progress->pages, progress->elapsed,
+                           progress->previous);
+  } else {
+    text = g_strdup_printf("%s [%u] %.1fs",
+                           progress->file ? progress->file : "",
+                           progress->pages, progress->elapsed);
+  }
+
+  gtk_label_set_text(GTK_LABEL(pc->progress), text);
+  if (tooltip) gtk_widget_set_tooltip_text(pc->progress, tooltip);
+  g_free(text);
+  g_free(tooltip);
+}
+
 inline static gint get_document_margin(GuPreviewGui* pc)
 {
   if (pc->pageLayout == POPPLER_PAGE_LAYOUT_SINGLE_PAGE) {
@@ -1065,8 +1136,17 @@ void previewgui_refresh(GuPreviewGui* pc, GtkTextIter *sync_to,
 {
   //L_F_DEBUG;
   /* We lock the mutex to prevent previewing imcomplete PDF file, i.e
-   * compiling. Also prevent PDF from changing (compiling) when previewing */
-  if (!g_mutex_trylock(&gummi->motion->compile_mutex)) return;
+   * compiling. Also prevent PDF from changing (compiling) when previewing.
+   * The next compile usually holds it by the time its predecessor's result
+   * arrives, the compile thread then waits for the refresh in between */
+  if (!g_mutex_trylock(&gummi->motion->compile_mutex)) {
+    pc->refresh_editor = gummi_get_active_editor();
+    pc->refresh_sync = sync_to != NULL;
+    g_free(pc->refresh_file);
+    pc->refresh_file = g_strdup(tex_file);
+    motion_defer_refresh(gummi->motion);
+    return;
+  }
 
   /* This line is very important, if no pdf exist, preview will fail */
   if (!pc->uri || !utils_path_exists(pc->uri + usize)) goto unlock;
@@ -1129,6 +1209,19 @@ unlock:
   g_mutex_unlock(&gummi->motion->compile_mutex);
 }
 
+void previewgui_refresh_deferred(GuPreviewGui* pc)
+{
+  GuEditor* ec = gummi_get_active_editor();
+  gpointer editor = pc->refresh_editor;
+  gchar* file = pc->refresh_file;
+
+  pc->refresh_editor = NULL;
+  pc->refresh_file = NULL;
+  if (editor && editor == ec)
+    previewgui_refresh(pc, pc->refresh_sync ? &ec->last_edit : NULL, file);
+  g_free(file);
+}
+
 static gboolean synctex_run_parser(GuPreviewGui* pc, GtkTextIter *sync_to,
                                    gchar* tex_file)
 {
@@ -1596,12 +1689,228 @@ static cairo_surface_t* get_page_rendering(GuPreviewGui* pc, int page)
   return cairo_surface_reference(p->rendering);
 }
 
-void previewgui_reset(GuPreviewGui* pc)
+static void previewgui_clear_document(GuPreviewGui* pc)
 {
-  //L_F_DEBUG;
-  /* reset uri */
+  previewgui_invalidate_renderings(pc);
+  g_free(pc->pages);
+  pc->pages = NULL;
+  pc->n_pages = 0;
+  previewgui_cleanup_fds(pc);
   g_free(pc->uri);
   pc->uri = NULL;
+}
+
+static void previewgui_state_drop_renderings(GuPreviewGui* pc,
+                                             GuPreviewState* st)
+{
+  int i;
+  for (i = 0; i < st->n_pages; i++) {
+    if ((st->pages + i)->rendering == NULL) continue;
+    cairo_surface_destroy((st->pages + i)->rendering);
+    (st->pages + i)->rendering = NULL;
+    st->cache_size -= page_inner(st, i).width *
+                      page_inner(st, i).height * BYTES_PER_PIXEL;
+  }
+  pc->parked_size -= st->cache_size;
+  st->cache_size = 0;
+
+  /* a loaded document holds on to as much memory as a few renderings */
+  if (st->doc) {
+    g_object_unref(st->doc);
+    st->doc = NULL;
+  }
+}
+
+static void previewgui_state_free(gpointer data)
+{
+  GuPreviewState* st = GU_PREVIEW_STATE(data);
+
+  int i;
+  for (i = 0; i < st->n_pages; i++) {
+    if ((st->pages + i)->rendering)
+      cairo_surface_destroy((st->pages + i)->rendering);
+  }
+  g_free(st->pages);
+  if (st->doc) g_object_unref(st->doc);
+  g_free(st->uri);
+  g_free(st);
+}
+
+/**
+ * previewgui_park_state:
+ *
+ * Moves the document of the tab that is left out of the preview. Only the
+ * pointers change hands, the renderings stay counted against cache_size
+ * until the garbage collector needs the room.
+ */
+static void previewgui_park_state(GuPreviewGui* pc)
+{
+  GuPreviewState* st = NULL;
+
+  if (!pc->owner || !pc->uri || !pc->doc) {
+    previewgui_clear_document(pc);
+    return;
+  }
+
+  st = g_new0(GuPreviewState, 1);
+  st->doc = pc->doc;
+  st->uri = pc->uri;
+  st->pages = pc->pages;
+  st->n_pages = pc->n_pages;
+  st->current_page = pc->current_page;
+  st->cache_size = pc->cache_size;
+  st->max_page_height = pc->max_page_height;
+  st->height_pages = pc->height_pages;
+  st->width_pages = pc->width_pages;
+  st->height_scaled = pc->height_scaled;
+  st->width_scaled = pc->width_scaled;
+  st->width_no_scale = pc->width_no_scale;
+  st->scale = pc->scale;
+  st->x = gtk_adjustment_get_value(pc->hadj);
+  st->y = gtk_adjustment_get_value(pc->vadj);
+  st->parked = g_get_real_time();
+
+  g_hash_table_replace(pc->states, pc->owner, st);
+  pc->parked_size += st->cache_size;
+
+  pc->doc = NULL;
+  pc->uri = NULL;
+  pc->pages = NULL;
+  pc->n_pages = 0;
+  pc->cache_size = 0;
+}
+
+/**
+ * previewgui_restore_state:
+ *
+ * Shows the document the editor had when its tab was left, at the same page
+ * and position. A pdf that was written since (by a background compile), or
+ * whose document was evicted, is reloaded, an unreadable one drops the
+ * state. Returns TRUE if restored.
+ */
+static gboolean previewgui_restore_state(GuPreviewGui* pc, GuEditor* ec)
+{
+  GuPreviewState* st = g_hash_table_lookup(pc->states, ec);
+  GStatBuf sb;
+  gint64 parked = 0;
+  gdouble x = 0, y = 0;
+
+  if (!st) return FALSE;
+
+  g_hash_table_steal(pc->states, ec);
+  pc->parked_size -= st->cache_size;
+
+  pc->doc = st->doc;
+  pc->uri = st->uri;
+  pc->pages = st->pages;
+  pc->n_pages = st->n_pages;
+  pc->current_page = st->current_page;
+  pc->cache_size = st->cache_size;
+  pc->max_page_height = st->max_page_height;
+  pc->height_pages = st->height_pages;
+  pc->width_pages = st->width_pages;
+  pc->height_scaled = st->height_scaled;
+  pc->width_scaled = st->width_scaled;
+  pc->width_no_scale = st->width_no_scale;
+  pc->scale = st->scale;
+  x = st->x;
+  y = st->y;
+  parked = st->parked;
+  g_free(st);
+
+  if (g_stat(pc->uri + usize, &sb) != 0) {
+    previewgui_clear_document(pc);
+    return FALSE;
+  }
+
+  /* mtime only has a resolution of seconds, so anything written in the
+   * second the tab was left is loaded again as well. So is a document the
+   * garbage collector took */
+  if (!pc->doc || (gint64)sb.st_mtime >= parked / G_USEC_PER_SEC) {
+    previewgui_cleanup_fds(pc);
+    pc->doc = poppler_document_new_from_file(pc->uri, NULL, NULL);
+    if (pc->doc == NULL) {
+      previewgui_clear_document(pc);
+      return FALSE;
+    }
+    load_document(pc, TRUE);
+  } else {
+    gchar* label = g_strdup_printf(_("of %d"), pc->n_pages);
+    gtk_label_set_text(GTK_LABEL(pc->page_label), label);
+    g_free(label);
+  }
+
+  /* the preview may have been resized meanwhile, only a changed scale
+   * costs the renderings */
+  update_fit_scale(pc);
+  update_scaled_size(pc);
+  update_page_positions(pc);
+  update_drawarea_size(pc);
+  previewgui_set_current_page(pc, pc->current_page);
+  previewgui_goto_xy(pc, x, y);
+  gtk_widget_queue_draw(pc->drawarea);
+
+  slog(L_DEBUG, "Restored preview of %s\n", ec->filename ? ec->filename
+                                                         : ec->workfile);
+  return TRUE;
+}
+
+static void previewgui_evict_oldest_state(GuPreviewGui* pc)
+{
+  GHashTableIter iter;
+  gpointer value = NULL;
+  GuPreviewState* oldest = NULL;
+
+  g_hash_table_iter_init(&iter, pc->states);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    GuPreviewState* st = GU_PREVIEW_STATE(value);
+    if (st->cache_size > 0 && (!oldest || st->parked < oldest->parked))
+      oldest = st;
+  }
+
+  if (oldest) {
+    previewgui_state_drop_renderings(pc, oldest);
+  } else {
+    /* can't happen, but never loop on a miscounted parked_size */
+    pc->parked_size = 0;
+  }
+}
+
+void previewgui_drop_state(GuPreviewGui* pc, gpointer editor)
+{
+  GuPreviewState* st = g_hash_table_lookup(pc->states, editor);
+
+  if (editor == pc->owner) pc->owner = NULL;
+  if (!st) return;
+
+  pc->parked_size -= st->cache_size;
+  g_hash_table_remove(pc->states, editor);
+}
+
+void previewgui_reset(GuPreviewGui* pc)
+{
+  //L_F_DEBUG;
+  GuEditor* ec = gummi_get_active_editor();
+
+  if (ec != pc->owner) {
+    /* a tab switch, the preview of the tab that was left is kept */
+    synctex_clear_sync_nodes(pc);
+    previewgui_park_state(pc);
+    pc->owner = ec;
+    if (ec) previewgui_restore_state(pc, ec);
+  } else {
+    /* reset uri */
+    g_free(pc->uri);
+    pc->uri = NULL;
+  }
+
+  /* a background compile may have the document ready already, it is shown
+   * until the compile below has finished */
+  if (!pc->uri && ec && motion_pdf_is_current(ec)) {
+    gchar* uri = g_strconcat(urifrmt, ec->pdffile, NULL);
+    previewgui_set_pdffile(pc, uri);
+    g_free(uri);
+  }
 
   gummi->latex->modified_since_compile = TRUE;
   previewgui_stop_preview(pc);
@@ -1885,6 +2194,17 @@ gboolean run_garbage_collector(GuPreviewGui* pc)
 
   gint max_cache_size = atoi(config_get_value("cache_size")) * 1024 * 1024;
 
+  if (pc->cache_size + pc->parked_size < max_cache_size) {
+    return FALSE;
+  }
+
+  // The tabs that are not shown give up their renderings first, the one
+  // that was left longest ago before the others.
+  while (pc->parked_size > 0 &&
+         pc->cache_size + pc->parked_size >= max_cache_size / 2) {
+    previewgui_evict_oldest_state(pc);
+  }
+
   if (pc->cache_size < max_cache_size) {
     return FALSE;
   }
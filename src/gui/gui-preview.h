@@ -87,6 +87,37 @@ struct _GuPreviewPage {
 
 };
 
+#define GU_PREVIEW_STATE(x) ((GuPreviewState*)(x))
+typedef struct _GuPreviewState GuPreviewState;
+
+/**
+ *  The document, page geometry, renderings and position of a tab that is not
+ *  shown at the moment. Switching back moves it into the GuPreviewGui again,
+ *  so neither the document has to be reloaded nor the pages re-rendered.
+ *  The garbage collector takes the document along with the renderings, doc
+ *  is NULL then and it is loaded from uri again.
+ */
+struct _GuPreviewState {
+  PopplerDocument* doc;
+  gchar* uri;
+  GuPreviewPage* pages;
+  gint n_pages;
+  gint current_page;
+  gint cache_size;
+
+  gdouble max_page_height;
+  gdouble height_pages;
+  gdouble width_pages;
+  gdouble height_scaled;
+  gdouble width_scaled;
+  gdouble width_no_scale;
+  gdouble scale;
+  gdouble x;
+  gdouble y;
+
+  gint64 parked;    // when the tab was left, oldest renderings go first
+};
+
 #define GU_PREVIEW_GUI(x) ((GuPreviewGui*)x)
 typedef struct _GuPreviewGui GuPreviewGui;
 
@@ -97,6 +128,7 @@ struct _GuPreviewGui {
   GtkViewport* previewgui_viewport;
   GtkWidget* previewgui_toolbar;
   GtkWidget* statuslight;
+  GtkWidget* progress;
   GtkWidget* drawarea;
   GtkWidget* page_next;
   GtkWidget* page_prev;
@@ -160,6 +192,14 @@ struct _GuPreviewGui {
   gint ascroll_dist_y;
 
   GSList *sync_nodes;
+
+  gpointer owner;         // editor the shown document belongs to
+  GHashTable* states;     // editor -> GuPreviewState of the other tabs
+  gint parked_size;       // renderings kept by those states
+
+  gpointer refresh_editor;  // editor of a refresh that had to wait
+  gboolean refresh_sync;    // that refresh syncs to the last edit
+  gchar* refresh_file;      // and the tex file it syncs to
 };
 
 GuPreviewGui* previewgui_init(GtkBuilder * builder);
@@ -167,6 +207,14 @@ void previewgui_update_statuslight(const gchar* type);
 void previewgui_set_pdffile(GuPreviewGui* prev, const gchar *uri);
 void previewgui_refresh(GuPreviewGui* prev, GtkTextIter *sync_to,
                         gchar* tex_file);
+
+/**
+ * previewgui_refresh_deferred:
+ *
+ * Runs the refresh that previewgui_refresh had to put off while a compile
+ * held compile_mutex, if the editor it was for is still shown.
+ */
+void previewgui_refresh_deferred(GuPreviewGui* pc);
 void previewgui_set_pagedata(GuPreviewGui* prev);
 void previewgui_goto_page(GuPreviewGui* prev, int page_number);
 void previewgui_scroll_to_page(GuPreviewGui* pc, int page);
@@ -176,6 +224,7 @@ void previewgui_save_position(GuPreviewGui* pc);
 void previewgui_restore_position(GuPreviewGui* pc);
 void previewgui_reset(GuPreviewGui* pc);
 void previewgui_cleanup_fds(GuPreviewGui* pc);
+void previewgui_drop_state(GuPreviewGui* pc, gpointer editor);
 void previewgui_start_preview(GuPreviewGui* pc);
 void previewgui_drawarea_resize(GuPreviewGui* pc);
 void previewgui_stop_preview(GuPreviewGui* pc);
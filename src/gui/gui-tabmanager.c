@@ -170,6 +170,7 @@ gint tabmanagergui_replace_page(GuTabContext* tc, GuEditor* newec)
 
   gtk_container_remove(GTK_CONTAINER(tc->page->scrollw),
                        GTK_WIDGET(g_active_editor->view));
+  previewgui_drop_state(gui->previewgui, g_active_editor);
   editor_destroy(g_active_editor);
 
   g_object_ref(newec->view);
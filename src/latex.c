@@ -29,10 +29,19 @@
 
 #include "latex.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#ifndef WIN32
+#   include <sys/wait.h>
+#endif
+
+#ifndef WEXITSTATUS
+#   define WEXITSTATUS(stat_val) ((unsigned int) (stat_val) >> 8)
+#endif
 
 #include <gtk/gtk.h>
 #include <glib.h>
@@ -40,37 +49,161 @@
 
 #include "configfile.h"
 #include "constants.h"
+#include "deptracker.h"
 #include "editor.h"
 #include "environment.h"
 #include "external.h"
+#include "gui/gui-main.h"
 #include "gui/gui-preview.h"
+#include "project.h"
 #include "utils.h"
 
 #include "compile/rubber.h"
 #include "compile/latexmk.h"
 #include "compile/texlive.h"
 
+/* don't flood the main loop with progress reports */
+#define PROGRESS_INTERVAL (G_USEC_PER_SEC / 10)
+
 extern Gummi* gummi;
+extern GummiGui* gui;
+
+static void latex_on_compile_output(const gchar* data, gsize len,
+                                    gpointer user);
+static void latex_commit_workfile(GuLatex* lc, GuEditor* ec,
+                                  const gchar* text);
+static void latex_write_workfile(GuEditor* ec, const gchar* text);
+static gchar* latex_update_overlays(GuLatex* lc, GSList* overlays);
+static void latex_overlay_free(gpointer data);
+static void latex_append_graphics_stats(GuLatex* lc);
+#ifndef WIN32
+static gboolean latex_write_all(gint fd, const gchar* data, gsize length);
+#endif
+static glong latex_run_pass(GuLatex* lc, GuEditor* ec, const gchar* command,
+                            const gchar* curdir);
+static gboolean latex_multipass_active(void);
+static gboolean latex_auxtools_active(void);
+static GSList* latex_parse_bibdata(const gchar* line, const gchar* docdir);
+static gchar* latex_get_auxtool_hash(GuEditor* ec, guint tool,
+                                     const gchar* path);
+static gchar* latex_get_auxhash(GuEditor* ec);
+static void latex_report_progress(GuLatex* lc, gboolean finished);
+static gboolean latex_dispatch_progress(gpointer user);
+static gboolean latex_output_cache_active(void);
+static gboolean latex_restore_output(GuLatex* lc, GuEditor* ec,
+                                     const gchar* key);
+static void latex_store_output(GuLatex* lc, GuEditor* ec, const gchar* key);
+static gboolean latex_get_focus_region(const gchar* text, gsize cursor,
+                                       gsize* start, gsize* end);
+static void latex_detect_externals(GuLatex* lc);
+static gboolean latex_externals_probed(gpointer user);
 
 GuLatex* latex_init(void)
 {
   GuLatex* l = g_new0(GuLatex, 1);
   l->compilelog = NULL;
+  l->logparser = logparser_new();
   l->modified_since_compile = FALSE;
+  l->depstamp = NULL;
+  l->reported_file = NULL;
+  l->last_duration = 0;
+  l->auxtool_hashes = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, g_free);
+  l->auxtool_output = NULL;
 
-  l->tex_version = texlive_init();
-  rubber_init();
-  latexmk_init();
+  /* cached versions only, the window must not wait for the probes */
+  external_init();
+  latex_detect_externals(l);
+  external_probe_pending(latex_externals_probed, l);
 
   /* TODO: Temp hard set of compilation options for migrating configs */
   if (strlen(config_get_value("typesetter")) == 0)
     config_set_value("typesetter", "pdflatex");
   if (strlen(config_get_value("compile_steps")) == 0)
     config_set_value("compile_steps", "texpdf");
+  if (STR_EQU(config_get_value("preamble_cache"), ""))
+    config_set_value("preamble_cache", "True");
+  if (STR_EQU(config_get_value("warm_typesetter"), ""))
+    config_set_value("warm_typesetter", "False");
+  if (STR_EQU(config_get_value("output_cache"), ""))
+    config_set_value("output_cache", "True");
+  if (STR_EQU(config_get_value("output_cache_size"), ""))
+    config_set_value("output_cache_size", "64");
+  if (STR_EQU(config_get_value("max_passes"), ""))
+    config_set_value("max_passes", "3");
+  if (STR_EQU(config_get_value("auxtools"), ""))
+    config_set_value("auxtools", "True");
+  if (STR_EQU(config_get_value("scratch_in_ram"), ""))
+    config_set_value("scratch_in_ram", "False");
+  if (STR_EQU(config_get_value("focus_preview"), ""))
+    config_set_value("focus_preview", "False");
+  if (STR_EQU(config_get_value("includeonly"), ""))
+    config_set_value("includeonly", "True");
+  if (STR_EQU(config_get_value("watch_dependencies"), ""))
+    config_set_value("watch_dependencies", "True");
+  if (STR_EQU(config_get_value("draft_pass"), ""))
+    config_set_value("draft_pass", "False");
+  if (STR_EQU(config_get_value("full_build_delay"), ""))
+    config_set_value("full_build_delay", "5");
+  if (STR_EQU(config_get_value("graphics_cache"), ""))
+    config_set_value("graphics_cache", "True");
+  if (STR_EQU(config_get_value("graphics_cache_size"), ""))
+    config_set_value("graphics_cache_size", "256");
+  if (STR_EQU(config_get_value("image_proxies"), ""))
+    config_set_value("image_proxies", "False");
+  if (STR_EQU(config_get_value("image_proxy_size"), ""))
+    config_set_value("image_proxy_size", "1600");
+  if (STR_EQU(config_get_value("tikz_external"), ""))
+    config_set_value("tikz_external", "False");
+  if (STR_EQU(config_get_value("tikz_jobs"), ""))
+    config_set_value("tikz_jobs", "0");
+
+  gchar* cachedir = g_build_filename(C_TMPDIR, "outputcache", NULL);
+  l->outputcache = cache_init(cachedir);
+  g_free(cachedir);
+
+  l->graphics = graphics_init();
+  l->tikz = tikz_init();
+
+  /* TeX looks in the overlay directory before anywhere else, so the
+   * unsaved project members found there shadow their saved files. The
+   * image proxies and the converted graphics come right after it */
+  const gchar* texinputs = g_getenv("TEXINPUTS");
+  l->texinputs = g_strdup(texinputs);
+  l->overlaydir = g_build_filename(C_TMPDIR, "overlay", NULL);
+  l->overlays = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                      g_free, g_free);
+  gchar* searchpath = g_strconcat(l->overlaydir, G_SEARCHPATH_SEPARATOR_S,
+                                  l->graphics->proxydir,
+                                  G_SEARCHPATH_SEPARATOR_S,
+                                  l->graphics->dir, G_SEARCHPATH_SEPARATOR_S,
+                                  texinputs ? texinputs : "", NULL);
+  g_setenv("TEXINPUTS", searchpath, TRUE);
+  g_free(searchpath);
 
   return l;
 }
 
+static void latex_detect_externals(GuLatex* lc)
+{
+  lc->tex_version = texlive_init();
+  rubber_init();
+  latexmk_init();
+}
+
+static gboolean latex_externals_probed(gpointer user)
+{
+  GuLatex* lc = GU_LATEX(user);
+
+  latex_detect_externals(lc);
+  slog(L_DEBUG, "External tools probed, texlive version %d\n",
+       lc->tex_version);
+
+  /* synctex depends on the texlive version */
+  if (gui) gui_set_synctex_sensitivity(gui);
+  return FALSE;
+}
+
 
 
 gboolean latex_method_active(gchar* method)
@@ -81,22 +214,365 @@ gboolean latex_method_active(gchar* method)
   return FALSE;
 }
 
+static gchar* latex_get_dependency_stamp(GuEditor* ec, const gchar* text)
+{
+  /* Files pulled in by the document take part in the cache key of the
+   * compile output through their modification time and size */
+  const gchar* exts[] = { "", ".tex", ".bib", ".pdf", ".png", ".jpg",
+                          ".jpeg", ".eps", NULL };
+  GString* stamp = g_string_new("");
+  GError* err = NULL;
+  GRegex* match_str = NULL;
+  GMatchInfo* match_info = NULL;
+  GStatBuf st;
+
+  if (!(match_str = g_regex_new("\\\\(?:input|include|includegraphics|"
+                                "bibliography|addbibresource)\\*?"
+                                "(?:\\[[^\\]]*\\])?\\{([^}]+)\\}",
+                                0, 0, &err))) {
+    slog(L_ERROR, "g_regex_new (): %s\n", err->message);
+    g_error_free(err);
+    return g_string_free(stamp, FALSE);
+  }
+
+  gchar* dirname = g_path_get_dirname(ec->filename ? ec->filename
+                                                   : ec->workfile);
+  g_regex_match(match_str, text, 0, &match_info);
+  while (g_match_info_matches(match_info)) {
+    gchar* names = g_match_info_fetch(match_info, 1);
+    gchar** list = g_strsplit(names, ",", 0);
+    gint i = 0, j = 0;
+    for (i = 0; list[i]; ++i) {
+      gchar* name = g_strstrip(list[i]);
+      for (j = 0; exts[j]; ++j) {
+        gchar* file = g_strconcat(name, exts[j], NULL);
+        gchar* path = g_path_is_absolute(file) ? g_strdup(file)
+                    : g_build_filename(dirname, file, NULL);
+        if (g_stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+          g_string_append_printf(stamp, "%s:%ld:%ld;", path,
+                                 (glong)st.st_mtime, (glong)st.st_size);
+        }
+        g_free(path);
+        g_free(file);
+      }
+    }
+    g_strfreev(list);
+    g_free(names);
+    g_match_info_next(match_info, NULL);
+  }
+  g_match_info_free(match_info);
+  g_regex_unref(match_str);
+  g_free(dirname);
+
+  /* Inputs the regex can't see, like files pulled in by a package, are
+   * known from the recorder output of the previous compile */
+  if (latex_recorder_active()) {
+    gchar* flsfile = latex_get_recorder_file(ec);
+    GSList* inputs = deptracker_read_recorder(flsfile);
+    GSList* iter = NULL;
+    for (iter = inputs; iter; iter = iter->next) {
+      if (g_stat(iter->data, &st) == 0 && S_ISREG(st.st_mode)) {
+        g_string_append_printf(stamp, "%s:%ld:%ld;", (gchar*)iter->data,
+                               (glong)st.st_mtime, (glong)st.st_size);
+      }
+    }
+    g_slist_free_full(inputs, g_free);
+    g_free(flsfile);
+  }
+  return g_string_free(stamp, FALSE);
+}
+
+static void latex_write_workfile(GuEditor* ec, const gchar* text)
+{
+#ifdef WIN32
+  utils_set_file_contents(ec->workfile, text, -1);
+#else
+  gsize length = strlen(text);
+  gsize oldlength = ec->worktext ? strlen(ec->worktext) : 0;
+  gsize start = 0;
+  gsize end = length;
+
+  /* The workfile is scratch data, it is updated in place through a file
+   * descriptor that stays open and never synced. Saving the document
+   * goes through the atomic path in iofunctions. */
+  if (ec->workfd != -1 && !g_file_test(ec->workfile, G_FILE_TEST_EXISTS)) {
+    close(ec->workfd);
+    ec->workfd = -1;
+  }
+  if (ec->workfd == -1) {
+    g_free(ec->worktext);
+    ec->worktext = NULL;
+    oldlength = 0;
+    ec->workfd = g_open(ec->workfile, O_WRONLY | O_CREAT, 0644);
+    if (ec->workfd == -1) {
+      utils_set_file_contents(ec->workfile, text, -1);
+      return;
+    }
+  }
+
+  /* Only the changed range goes to disk. When the length changed all
+   * that follows the first difference has moved and is rewritten. */
+  if (ec->worktext) {
+    while (start < length && start < oldlength &&
+           text[start] == ec->worktext[start])
+      ++start;
+    if (length == oldlength) {
+      while (end > start && text[end - 1] == ec->worktext[end - 1])
+        --end;
+    }
+  }
+
+  if (lseek(ec->workfd, start, SEEK_SET) == -1 ||
+      !latex_write_all(ec->workfd, text + start, end - start) ||
+      ftruncate(ec->workfd, length) == -1) {
+    slog(L_ERROR, "Could not update workfile %s\n", ec->workfile);
+    close(ec->workfd);
+    ec->workfd = -1;
+    utils_set_file_contents(ec->workfile, text, -1);
+    return;
+  }
+
+  g_free(ec->worktext);
+  ec->worktext = g_strdup(text);
+#endif
+}
+
+#ifndef WIN32
+static gboolean latex_write_all(gint fd, const gchar* data, gsize length)
+{
+  gssize written = 0;
+
+  while (length > 0) {
+    if ((written = write(fd, data, length)) < 0) {
+      if (errno == EINTR) continue;
+      return FALSE;
+    }
+    data += written;
+    length -= written;
+  }
+  return TRUE;
+}
+#endif
+
 gchar* latex_update_workfile(GuLatex* lc, GuEditor* ec)
 {
   gchar *text;
 
   text = editor_grab_buffer(ec);
+  latex_commit_workfile(lc, ec, text);
+
+  /* overlays of a project must not leak into other documents */
+  if (g_hash_table_size(lc->overlays))
+    g_free(latex_update_overlays(lc, NULL));
+  return text;
+}
+
+gchar* latex_update_root_workfile(GuLatex* lc, GuEditor* root,
+                                  const gchar* include, GSList* overlays)
+{
+  gchar* text = editor_grab_buffer(root);
+  gchar* auxfile = NULL;
+  gchar* begin = NULL;
+  gchar* only = NULL;
+  GRegex* include_str = NULL;
+  GMatchInfo* match_info = NULL;
+  gboolean partial = FALSE;
+
+  if (!(include_str = g_regex_new("\\\\include\\{\\s*([^}]+?)"
+                                  "(?:\\.tex)?\\s*\\}", 0, 0, NULL))) {
+    latex_commit_workfile(lc, root, text);
+    return text;
+  }
+
+  /* The .aux files of the chapters that are left out come from the last
+   * full build, without one there is nothing to reuse */
+  auxfile = g_strdup_printf("%.*s.aux", (gint)strlen(root->pdffile) - 4,
+                            root->pdffile);
+  begin = strstr(text, "\\begin{document}");
+
+  /* TeX doesn't create the directories for the .aux files of included
+   * files in the output directory by itself */
+  g_regex_match(include_str, text, 0, &match_info);
+  while (g_match_info_matches(match_info)) {
+    gchar* name = g_match_info_fetch(match_info, 1);
+    gchar* dir = g_path_get_dirname(name);
+    if (!STR_EQU(dir, ".") && !g_path_is_absolute(dir)) {
+      gchar* path = g_build_filename(C_TMPDIR, dir, NULL);
+      g_mkdir_with_parents(path, DIR_PERMS);
+      g_free(path);
+    }
+    if (STR_EQU(name, include)) partial = TRUE;
+    g_free(dir);
+    g_free(name);
+    g_match_info_next(match_info, NULL);
+  }
+  g_match_info_free(match_info);
+  g_regex_unref(include_str);
+
+  /* What \includeonly does, but right behind \begin{document}: on the
+   * same line to keep line numbers, and after the preamble so the
+   * preamble format is the same for every chapter and the full build */
+  if (partial && begin && utils_path_exists(auxfile)) {
+    begin += strlen("\\begin{document}");
+    only = g_strdup_printf("%.*s\\csname @partswtrue\\endcsname"
+                           "\\expandafter\\def"
+                           "\\csname @partlist\\endcsname{%s}%s",
+                           (gint)(begin - text), text, include, begin);
+    slog(L_DEBUG, "Building %s with \\includeonly{%s}\n", root->filename,
+         include);
+    g_free(text);
+    text = only;
+  }
+  latex_commit_workfile(lc, root, text);
+
+  /* the root text doesn't change with its members, their unsaved content
+   * has to show up in the key of the output cache */
+  gchar* overlaystamp = latex_update_overlays(lc, overlays);
+  gchar* depstamp = g_strconcat(lc->depstamp, overlaystamp, NULL);
+  g_free(lc->depstamp);
+  lc->depstamp = depstamp;
+  g_free(overlaystamp);
+
+  g_free(auxfile);
+  return text;
+}
+
+GSList* latex_grab_overlays(GuEditor* root)
+{
+  GList* editors = gummi_get_all_editors();
+  GList* iter = NULL;
+  GSList* overlays = NULL;
+
+  for (iter = editors; iter; iter = iter->next) {
+    GuEditor* ec = GU_EDITOR(iter->data);
+    GuOverlay* overlay = NULL;
+    gchar* name = NULL;
+
+    /* saved members are read from disk as usual */
+    if (ec == root || project_get_root_editor(ec) != root ||
+        !editor_buffer_changed(ec))
+      continue;
+    if (!(name = project_get_include_name(root, ec))) continue;
+
+    overlay = g_new0(GuOverlay, 1);
+    overlay->file = g_strconcat(name, g_str_has_suffix(ec->filename, ".tex")
+                                ? ".tex" : "", NULL);
+    overlay->text = editor_grab_buffer(ec);
+    overlays = g_slist_prepend(overlays, overlay);
+    g_free(name);
+  }
+  g_list_free(editors);
+  return g_slist_reverse(overlays);
+}
+
+static void latex_overlay_free(gpointer data)
+{
+  GuOverlay* overlay = GU_OVERLAY(data);
+
+  g_free(overlay->file);
+  g_free(overlay->text);
+  g_free(overlay);
+}
+
+void latex_free_overlays(GSList* overlays)
+{
+  g_slist_free_full(overlays, latex_overlay_free);
+}
+
+static gchar* latex_update_overlays(GuLatex* lc, GSList* overlays)
+{
+  GHashTable* current = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free, g_free);
+  GString* stamp = g_string_new("");
+  GSList* iter = NULL;
+  GHashTableIter hiter;
+  gpointer path = NULL;
+  GError* err = NULL;
+
+  for (iter = overlays; iter; iter = iter->next) {
+    GuOverlay* member = GU_OVERLAY(iter->data);
+    gchar* overlay = g_build_filename(lc->overlaydir, member->file, NULL);
+    gchar* hash = g_compute_checksum_for_string(G_CHECKSUM_MD5,
+                                                member->text, -1);
+
+    if (!STR_EQU(hash, g_hash_table_lookup(lc->overlays, overlay))) {
+      gchar* dir = g_path_get_dirname(overlay);
+      g_mkdir_with_parents(dir, DIR_PERMS);
+      if (!g_file_set_contents(overlay, member->text, -1, &err)) {
+        slog(L_ERROR, "Could not write overlay for %s: %s\n",
+             member->file, err->message);
+        g_clear_error(&err);
+      }
+      g_free(dir);
+    }
+    g_string_append_printf(stamp, "%s:%s;", member->file, hash);
+    g_hash_table_insert(current, overlay, hash);
+  }
+
+  /* members that were saved or closed meanwhile are read from disk again */
+  g_hash_table_iter_init(&hiter, lc->overlays);
+  while (g_hash_table_iter_next(&hiter, &path, NULL)) {
+    if (!g_hash_table_contains(current, path))
+      g_remove(path);
+  }
+  g_hash_table_unref(lc->overlays);
+  lc->overlays = current;
+
+  return g_string_free(stamp, FALSE);
+}
+
+static void latex_commit_workfile(GuLatex* lc, GuEditor* ec,
+                                  const gchar* text)
+{
+  gchar* hash = NULL;
+  gchar* draft = NULL;
+  gchar* external = NULL;
+  const gchar* begin = NULL;
+
+  /* externalized pictures are set up before the draft switch, the figures
+   * are typeset from a copy of the document without it */
+  if (tikz_active(text)) {
+    external = tikz_prepare(lc->tikz, ec, text, lc->proxies);
+    text = external;
+  } else {
+    g_hash_table_remove_all(lc->tikz->figures);
+  }
+
+  /* A draft has graphicx draw boxes instead of the images. The switch
+   * goes right behind \begin{document}: on the same line to keep line
+   * numbers, and after the preamble to keep using the preamble format */
+  if (lc->draft && (begin = strstr(text, "\\begin{document}"))) {
+    begin += strlen("\\begin{document}");
+    draft = g_strdup_printf("%.*s\\ifcsname KV@Gin@draft\\endcsname"
+                            "\\setkeys{Gin}{draft}\\fi %s",
+                            (gint)(begin - text), text, begin);
+    text = draft;
+  }
 
   // bit of a dirty hack, but only write the buffer content when
   // there is not a recovery in progress, otherwise the workfile
   // will be overwritten with empty text
   if (!STR_EQU(text, "")) {
-    utils_set_file_contents(ec->workfile, text, -1);
+    hash = g_compute_checksum_for_string(G_CHECKSUM_MD5, text, -1);
+    /* Don't touch the workfile when the buffer didn't change, the mtime
+     * would otherwise make every compile look like a fresh one */
+    if (!STR_EQU(hash, ec->workhash) ||
+        !g_file_test(ec->workfile, G_FILE_TEST_EXISTS)) {
+      latex_write_workfile(ec, text);
+    }
+    g_free(ec->workhash);
+    ec->workhash = hash;
   }
-  return text;
+
+  graphics_update(lc->graphics, ec, text, lc->proxies);
+
+  g_free(lc->depstamp);
+  lc->depstamp = latex_get_dependency_stamp(ec, text);
+  g_free(draft);
+  g_free(external);
 }
 
-gchar* latex_set_compile_cmd(GuEditor* ec)
+gchar* latex_set_compile_cmd(GuLatex* lc, GuEditor* ec)
 {
 
   const gchar* method = config_get_value("compile_steps");
@@ -108,6 +584,8 @@ gchar* latex_set_compile_cmd(GuEditor* ec)
   } else if (latexmk_active()) {
     texcmd = latexmk_get_command(method, ec->workfile, ec->basename);
   } else {
+    /* synctex is of no use for a draft that is replaced soon anyway */
+    texlive_set_draft(lc->draft);
     texcmd = texlive_get_command(method, ec->workfile, ec->basename);
   }
 
@@ -137,42 +615,9 @@ gchar* latex_analyse_log(gchar* log, gchar* filename, gchar* basename)
 
 
 
-void latex_analyse_errors(GuLatex* lc)
-{
-  gchar* result = NULL;
-  GError* err = NULL;
-  GRegex* match_str = NULL;
-  GMatchInfo* match_info;
-
-  if (!(match_str = g_regex_new(":(\\d+):", G_REGEX_DOTALL, 0, &err))) {
-    slog(L_ERROR, "g_regex_new (): %s\n", err->message);
-    g_error_free(err);
-    return;
-  }
-
-  if (lc->compilelog == NULL) printf("null\n");
-
-  if (g_regex_match(match_str, lc->compilelog, 0, &match_info)) {
-    gint count = 0;
-    while (g_match_info_matches(match_info)) {
-      if (count + 1 == BUFSIZ) break;
-      result = g_match_info_fetch(match_info, 1);
-      lc->errorlines[count++] = atoi(result);
-      g_free(result);
-      g_match_info_next(match_info, NULL);
-    }
-  }
-  if (!lc->errorlines[0])
-    lc->errorlines[0] = -1;
-  g_match_info_free(match_info);
-  g_regex_unref(match_str);
-}
-
 void latex_update_pdffile(GuLatex* lc, GuEditor* ec)
 {
   static glong cerrors = 0;
-  gchar* basename = ec->basename;
-  gchar* filename = ec->filename;
 
   if (!lc->modified_since_compile) {
     lc->compile_status = cerrors == 0;
@@ -186,33 +631,497 @@ void latex_update_pdffile(GuLatex* lc, GuEditor* ec)
   }
 
   /* create compile command */
-  gchar* curdir = g_path_get_dirname(ec->workfile);
-  gchar *command = latex_set_compile_cmd(ec);
+  gchar* curdir = editor_get_compile_dir(ec);
+  gchar *command = latex_set_compile_cmd(lc, ec);
 
   g_free(lc->compilelog);
-  memset(lc->errorlines, 0, BUFSIZ);
+  lc->compilelog = NULL;
+  logparser_reset(lc->logparser);
+
+  lc->compile_start = g_get_monotonic_time();
+  lc->last_report = 0;
+  lc->reported_pages = 0;
+  lc->first_page = 0;
 
-  /* run pdf compilation */
-  Tuple2 cresult = utils_popen_r(command, curdir);
-  cerrors = (glong)cresult.first;
-  gchar* coutput = (gchar*)cresult.second;
+  /* an identical compile ran before, restore its output */
+  gchar* key = NULL;
+  if (latex_output_cache_active() && ec->workhash) {
+    key = cache_get_key(ec->workhash, command, lc->depstamp,
+                        lc->proxies ? "proxies" : "", NULL);
+    if (latex_restore_output(lc, ec, key)) {
+      slog(L_DEBUG, "Restored compile output from cache (%u hits, "
+           "%u misses)\n", lc->outputcache->hits, lc->outputcache->misses);
+      logparser_feed(lc->logparser, lc->compilelog, -1);
+      logparser_finish(lc->logparser);
+      latex_append_graphics_stats(lc);
+      latex_report_progress(lc, TRUE);
+      lc->modified_since_compile = FALSE;
+      cerrors = 0;
+      g_free(key);
+      g_free(command);
+      g_free(curdir);
+      lc->compile_status = TRUE;
+      return;
+    }
+  }
 
-  lc->compilelog = latex_analyse_log(coutput, filename, basename);
+  /* run pdf compilation, rerunning while cross references settle */
+  gchar* auxhash = latex_multipass_active() ? latex_get_auxhash(ec) : NULL;
+  gint maxpasses = atoi(config_get_value("max_passes"));
+  gint passes = 0;
+  do {
+    cerrors = latex_run_pass(lc, ec, command, curdir);
+    if (cerrors) break;
+
+    /* bibliographies, indices and glossaries need another pass to show,
+     * so do the externalized pictures that were just built */
+    gboolean rerun = latex_auxtools_active() &&
+                     latex_run_auxtools(lc, ec, AUX_ALL, FALSE);
+    if (g_hash_table_size(lc->tikz->figures))
+      rerun = tikz_build_figures(lc->tikz, ec, curdir) || rerun;
+    if (!auxhash && !rerun) break;
+
+    if (auxhash) {
+      gchar* newhash = latex_get_auxhash(ec);
+      gboolean stable = STR_EQU(newhash, auxhash);
+      g_free(auxhash);
+      auxhash = newhash;
+      if (stable && !rerun) break;
+    }
+    slog(L_DEBUG, "Auxiliary files changed after pass %d\n", passes + 1);
+  } while (++passes < maxpasses);
+  g_free(auxhash);
   lc->modified_since_compile = FALSE;
 
-  /* find error line */
-  if (cerrors && (g_utf8_strlen(lc->compilelog, -1) != 0)) {
-    latex_analyse_errors(lc);
+  latex_report_progress(lc, TRUE);
+  lc->last_duration = (gdouble)(g_get_monotonic_time() - lc->compile_start)
+                      / G_USEC_PER_SEC;
+  slog(L_DEBUG, "Compile took %.2fs, first page after %.2fs\n",
+       lc->last_duration, lc->first_page);
+
+  if (key && cerrors == 0) {
+    latex_store_output(lc, ec, key);
   }
+  latex_append_graphics_stats(lc);
+  if (cerrors == 0 && g_hash_table_size(lc->tikz->figures))
+    tikz_prune(lc->tikz);
 
+  g_free(key);
   g_free(command);
+  g_free(curdir);
 
   lc->compile_status = cerrors == 0;
 }
 
+static void latex_append_graphics_stats(GuLatex* lc)
+{
+  gchar* stats = NULL;
+  gchar* log = NULL;
+
+  /* shown in the build log, after the output cache got its copy */
+  if (!lc->graphics->hits && !lc->graphics->misses) return;
+  stats = g_strdup_printf(_("Graphics: %u taken from the cache, %u "
+                            "converted"),
+                          lc->graphics->hits, lc->graphics->misses);
+  log = g_strdup_printf("%s\n%s\n", lc->compilelog ? lc->compilelog : "",
+                        stats);
+  g_free(lc->compilelog);
+  lc->compilelog = log;
+  g_free(stats);
+}
+
+static glong latex_run_pass(GuLatex* lc, GuEditor* ec, const gchar* command,
+                            const gchar* curdir)
+{
+  Tuple2 cresult;
+
+  g_free(lc->compilelog);
+  lc->compilelog = NULL;
+  logparser_reset(lc->logparser);
+
+  /* the output is parsed while it comes in */
+  if (texlive_warm_active())
+    cresult = texlive_warm_run(ec->workfile, curdir,
+                               latex_on_compile_output, lc);
+  else
+    cresult = utils_popen_r_full(command, curdir,
+                                 latex_on_compile_output, lc);
+
+  lc->compilelog = latex_analyse_log((gchar*)cresult.second, ec->filename,
+                                     ec->basename);
+
+  /* rubber doesn't pass on the typesetter output, parse its log instead */
+  if (rubber_active()) {
+    logparser_reset(lc->logparser);
+    logparser_feed(lc->logparser, lc->compilelog, -1);
+  }
+  logparser_finish(lc->logparser);
+
+  return (glong)cresult.first;
+}
+
+static gboolean latex_multipass_active(void)
+{
+  /* rubber and latexmk take care of reruns themselves */
+  if (rubber_active() || latexmk_active()) return FALSE;
+  return atoi(config_get_value("max_passes")) > 1;
+}
+
+static gchar* latex_get_auxhash(GuEditor* ec)
+{
+  const gchar* exts[] = { ".aux", ".toc", ".lof", ".lot", ".out", NULL };
+  GChecksum* checksum = g_checksum_new(G_CHECKSUM_MD5);
+  gchar* outbase = NULL;
+  gchar* contents = NULL;
+  gchar* ret = NULL;
+  gsize length = 0;
+  gint i = 0;
+
+  outbase = g_strndup(ec->pdffile, strlen(ec->pdffile) - strlen(".pdf"));
+  for (i = 0; exts[i]; ++i) {
+    gchar* path = g_strconcat(outbase, exts[i], NULL);
+    if (g_file_get_contents(path, &contents, &length, NULL)) {
+      g_checksum_update(checksum, (guchar*)contents, length);
+      g_free(contents);
+    }
+    /* separator, so content moving between files is noticed */
+    g_checksum_update(checksum, (guchar*)"", 1);
+    g_free(path);
+  }
+  g_free(outbase);
+
+  ret = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+  return ret;
+}
+
+static void latex_on_compile_output(const gchar* data, gsize len,
+                                    gpointer user)
+{
+  GuLatex* lc = GU_LATEX(user);
+  const gchar* file = NULL;
+  gint64 now = 0;
+
+  logparser_feed(lc->logparser, data, len);
+
+  now = g_get_monotonic_time();
+  if (lc->logparser->npages && !lc->first_page)
+    lc->first_page = (gdouble)(now - lc->compile_start) / G_USEC_PER_SEC;
+
+  if (now - lc->last_report < PROGRESS_INTERVAL) return;
+  file = logparser_current_file(lc->logparser);
+  if (lc->logparser->npages != lc->reported_pages ||
+      !STR_EQU(file, lc->reported_file)) {
+    latex_report_progress(lc, FALSE);
+  }
+}
+
+static void latex_report_progress(GuLatex* lc, gboolean finished)
+{
+  GuCompileProgress* progress = g_new0(GuCompileProgress, 1);
+  const gchar* file = logparser_current_file(lc->logparser);
+  gint64 now = g_get_monotonic_time();
+
+  progress->pages = lc->logparser->npages;
+  progress->file = file ? g_path_get_basename(file) : NULL;
+  progress->elapsed = (gdouble)(now - lc->compile_start) / G_USEC_PER_SEC;
+  progress->previous = lc->last_duration;
+  progress->first_page = lc->first_page;
+  progress->finished = finished;
+  progress->graphics_hits = lc->graphics->cache->hits;
+  progress->graphics_misses = lc->graphics->cache->misses;
+
+  lc->last_report = now;
+  lc->reported_pages = progress->pages;
+  g_free(lc->reported_file);
+  lc->reported_file = g_strdup(file);
+
+  g_idle_add(latex_dispatch_progress, progress);
+}
+
+static gboolean latex_dispatch_progress(gpointer user)
+{
+  GuCompileProgress* progress = GU_COMPILE_PROGRESS(user);
+
+  g_signal_emit_by_name(gui->previewgui->sig_hook, "document-progress",
+                        progress);
+  g_free(progress->file);
+  g_free(progress);
+  return FALSE;
+}
+
+static gboolean latex_output_cache_active(void)
+{
+  if (config_get_value("output_cache")) return TRUE;
+  return FALSE;
+}
+
+static gboolean latex_restore_output(GuLatex* lc, GuEditor* ec,
+                                     const gchar* key)
+{
+  const gchar* exts[] = { ".synctex.gz", ".aux", ".pdf", NULL };
+  gchar* entry = NULL;
+  gchar* outbase = NULL;
+  gchar* logfile = NULL;
+  gchar* log = NULL;
+  GError* err = NULL;
+  gint i = 0;
+
+  if (!(entry = cache_lookup(lc->outputcache, key))) return FALSE;
+
+  /* the pdf is stored last, an entry without it is incomplete */
+  gchar* pdffile = g_build_filename(entry, "output.pdf", NULL);
+  logfile = g_build_filename(entry, "output.log", NULL);
+  if (!g_file_test(pdffile, G_FILE_TEST_EXISTS) ||
+      !g_file_get_contents(logfile, &log, NULL, NULL)) {
+    g_free(pdffile);
+    g_free(logfile);
+    g_free(entry);
+    return FALSE;
+  }
+
+  outbase = g_strndup(ec->pdffile, strlen(ec->pdffile) - strlen(".pdf"));
+  for (i = 0; exts[i]; ++i) {
+    gchar* src = g_strconcat(entry, C_DIRSEP, "output", exts[i], NULL);
+    gchar* dest = g_strconcat(outbase, exts[i], NULL);
+    if (g_file_test(src, G_FILE_TEST_EXISTS) &&
+        !utils_copy_file(src, dest, &err)) {
+      slog(L_ERROR, "Could not restore %s: %s\n", dest, err->message);
+      g_error_free(err);
+      err = NULL;
+    }
+    g_free(dest);
+    g_free(src);
+  }
+
+  lc->compilelog = log;
+  g_free(outbase);
+  g_free(pdffile);
+  g_free(logfile);
+  g_free(entry);
+  return TRUE;
+}
+
+static void latex_store_output(GuLatex* lc, GuEditor* ec, const gchar* key)
+{
+  const gchar* exts[] = { ".synctex.gz", ".aux", ".pdf", NULL };
+  gchar* outbase = NULL;
+  gint i = 0;
+
+  if (!g_file_test(ec->pdffile, G_FILE_TEST_EXISTS)) return;
+
+  outbase = g_strndup(ec->pdffile, strlen(ec->pdffile) - strlen(".pdf"));
+  cache_store_contents(lc->outputcache, key, "output.log", lc->compilelog);
+  for (i = 0; exts[i]; ++i) {
+    gchar* src = g_strconcat(outbase, exts[i], NULL);
+    gchar* name = g_strconcat("output", exts[i], NULL);
+    if (g_file_test(src, G_FILE_TEST_EXISTS))
+      cache_store_file(lc->outputcache, key, name, src);
+    g_free(name);
+    g_free(src);
+  }
+  g_free(outbase);
+
+  cache_evict(lc->outputcache,
+              (goffset)atoi(config_get_value("output_cache_size")) << 20);
+}
+
+gboolean latex_includeonly_active(void)
+{
+  return TO_BOOL(config_get_value("includeonly"));
+}
+
+gboolean latex_draft_active(void)
+{
+  return TO_BOOL(config_get_value("draft_pass"));
+}
+
+gboolean latex_recorder_active(void)
+{
+  /* rubber doesn't pass the flags of the typesetter on */
+  return config_get_value("watch_dependencies") && !rubber_active();
+}
+
+gchar* latex_get_recorder_file(GuEditor* ec)
+{
+  return g_strdup_printf("%.*s.fls", (gint)strlen(ec->pdffile) - 4,
+                         ec->pdffile);
+}
+
+gboolean latex_focus_active(void)
+{
+  if (!config_get_value("focus_preview")) return FALSE;
+
+  /* The transient document is typeset directly, rubber and latexmk would
+   * want to manage its auxiliary files on their own */
+  if (rubber_active() || latexmk_active()) return FALSE;
+  return STR_EQU(config_get_value("compile_steps"), "texpdf");
+}
+
+gchar* latex_get_background_command(GuLatex* lc, GuEditor* ec)
+{
+#ifndef WIN32
+  if (!texlive_active() || rubber_active() || latexmk_active() ||
+      !STR_EQU(config_get_value("compile_steps"), "texpdf"))
+    return NULL;
+
+  /* The converted graphics, proxies, overlays and the preamble format all
+   * belong to the document in the foreground. Documents that need their
+   * graphics converted are left to it */
+  gchar* env = NULL;
+  if (lc->texinputs) {
+    gchar* quoted = g_shell_quote(lc->texinputs);
+    env = g_strdup_printf("TEXINPUTS=%s", quoted);
+    g_free(quoted);
+  } else {
+    env = g_strdup("-u TEXINPUTS");
+  }
+
+  /* the job name makes the output end up where the preview expects it */
+  gchar* jobname = g_path_get_basename(ec->pdffile);
+  jobname[strlen(jobname) - 4] = 0;
+
+  /* the synctex file of the previous build would no longer match */
+  gchar* command = g_strdup_printf("env %s %s %s -interaction=nonstopmode "
+                                   "-file-line-error -halt-on-error %s%s "
+                                   "-output-directory=\"%s\" "
+                                   "-jobname=\"%s\" \"%s\"",
+                                   env, C_TEXSEC,
+                                   pdflatex_active() ? C_PDFLATEX
+                                                     : C_XELATEX,
+                                   latex_use_shellescaping() ?
+                                     "-shell-escape" : "-no-shell-escape",
+                                   config_get_value("synctex") ?
+                                     " -synctex=1" : "",
+                                   C_TMPDIR, jobname, ec->backgroundfile);
+  g_free(jobname);
+  g_free(env);
+  return command;
+#else
+  return NULL;
+#endif
+}
+
+static gboolean latex_get_focus_region(const gchar* text, gsize cursor,
+                                       gsize* start, gsize* end)
+{
+  GError* err = NULL;
+  GRegex* match_str = NULL;
+  GMatchInfo* match_info = NULL;
+  const gchar* body = NULL;
+  const gchar* tail = NULL;
+  gsize bodystart = 0, bodyend = 0;
+  gint pos = 0;
+
+  if (!(body = strstr(text, "\\begin{document}"))) return FALSE;
+  bodystart = body - text + strlen("\\begin{document}");
+  tail = strstr(text + bodystart, "\\end{document}");
+  bodyend = tail ? (gsize)(tail - text) : strlen(text);
+
+  /* Edits in the preamble affect the whole document */
+  if (cursor < bodystart || cursor > bodyend) return FALSE;
+
+  if (!(match_str = g_regex_new("^[ \t]*\\\\(?:part|chapter|section)\\*?"
+                                "[ \t]*[\\[{]",
+                                G_REGEX_MULTILINE, 0, &err))) {
+    slog(L_ERROR, "g_regex_new (): %s\n", err->message);
+    g_error_free(err);
+    return FALSE;
+  }
+
+  /* The region runs from the last heading before the cursor up to the
+   * next one after it */
+  *start = bodystart;
+  *end = bodyend;
+  g_regex_match_full(match_str, text, bodyend, bodystart, 0,
+                     &match_info, NULL);
+  while (g_match_info_matches(match_info)) {
+    g_match_info_fetch_pos(match_info, 0, &pos, NULL);
+    if ((gsize)pos <= cursor) {
+      *start = pos;
+    } else {
+      *end = pos;
+      break;
+    }
+    g_match_info_next(match_info, NULL);
+  }
+  g_match_info_free(match_info);
+  g_regex_unref(match_str);
+
+  /* Not worth it when the region is most of the document anyway */
+  return (*end - *start) * 2 < bodyend - bodystart;
+}
+
+gboolean latex_update_focusfile(GuLatex* lc, GuEditor* ec, const gchar* text,
+                                gint offset)
+{
+  gsize start = 0, end = 0;
+  const gchar* cursor = NULL;
+  const gchar* body = NULL;
+  GString* focus = NULL;
+  GError* err = NULL;
+
+  if (offset < 0 || g_utf8_strlen(text, -1) < offset) return FALSE;
+  cursor = g_utf8_offset_to_pointer(text, offset);
+  if (!latex_get_focus_region(text, cursor - text, &start, &end))
+    return FALSE;
+
+  /* The preamble is copied verbatim so the preamble format still applies,
+   * skipped lines are kept as empty ones to keep line numbers in the log
+   * matching the editor */
+  body = strstr(text, "\\begin{document}") + strlen("\\begin{document}");
+  focus = g_string_new_len(text, body - text);
+  for (; body < text + start; ++body) {
+    if (*body == '\n') g_string_append_c(focus, '\n');
+  }
+  g_string_append_len(focus, text + start, end - start);
+  g_string_append(focus, "\n\\end{document}\n");
+
+  if (!g_file_set_contents(ec->focusfile, focus->str, focus->len, &err)) {
+    slog(L_ERROR, "Could not write focus document: %s\n", err->message);
+    g_error_free(err);
+    g_string_free(focus, TRUE);
+    return FALSE;
+  }
+  slog(L_DEBUG, "Focus preview of %" G_GSIZE_FORMAT " out of %"
+       G_GSIZE_FORMAT " bytes\n", end - start, strlen(text));
+  g_string_free(focus, TRUE);
+  return TRUE;
+}
+
+gboolean latex_update_focus_pdffile(GuLatex* lc, GuEditor* ec)
+{
+  gchar* curdir = editor_get_compile_dir(ec);
+  gchar* name = g_path_get_basename(ec->focusfile);
+  /* only the directory of the basename matters for texpdf, it has to be
+   * the document directory for the preamble format to dump correctly */
+  gchar* basename = g_build_filename(curdir, name, NULL);
+  gchar* texcmd = NULL;
+  gchar* command = NULL;
+  gint64 start = g_get_monotonic_time();
+
+  texlive_set_draft(lc->draft);
+  texcmd = texlive_get_command("texpdf", ec->focusfile, basename);
+  command = g_strdup_printf("%s %s", C_TEXSEC, texcmd);
+
+  /* The log isn't parsed, the full compile that follows reports errors */
+  Tuple2 res = utils_popen_r(command, curdir);
+  gboolean ok = (glong)res.first == 0 && utils_path_exists(ec->focuspdf);
+  slog(L_DEBUG, "Focus compile took %.2fs\n",
+       (gdouble)(g_get_monotonic_time() - start) / G_USEC_PER_SEC);
+
+  g_free(res.second);
+  g_free(command);
+  g_free(texcmd);
+  g_free(basename);
+  g_free(name);
+  g_free(curdir);
+  return ok;
+}
+
 void latex_update_auxfile(GuLatex* lc, GuEditor* ec)
 {
-  gchar* dirname = g_path_get_dirname(ec->workfile);
+  gchar* dirname = editor_get_compile_dir(ec);
   gchar* command = g_strdup_printf("%s %s "
                                    "--draftmode "
                                    "-interaction=nonstopmode "
@@ -283,6 +1192,16 @@ void latex_export_pdffile(GuLatex* lc, GuEditor* ec, const gchar* path,
       return;
     }
   }
+
+  /* The preview may be a draft or show image proxies. The compile thread
+   * builds the real thing and exports it when it is done. Background tabs
+   * are built without either */
+  if (ec == gummi_get_active_editor() &&
+      (latex_draft_active() || graphics_proxies_active())) {
+    motion_export_pdf(gummi->motion, ec, savepath);
+    g_free(savepath);
+    return;
+  }
   if (!utils_copy_file(ec->pdffile, savepath, &err)) {
     slog(L_G_ERROR, _("Unable to export PDF file.\n\n%s"),
          err->message);
@@ -292,24 +1211,241 @@ void latex_export_pdffile(GuLatex* lc, GuEditor* ec, const gchar* path,
   g_free(savepath);
 }
 
-gboolean latex_run_makeindex(GuEditor* ec)
+guint latex_run_auxtools(GuLatex* lc, GuEditor* ec, guint tools,
+                         gboolean force)
 {
-  int retcode;
+  const guint flags[] = { AUX_BIBTEX, AUX_MAKEINDEX, AUX_GLOSSARIES };
+  const gchar* inputs[] = { ".aux", ".idx", ".glo" };
+  GuProcess* procs[G_N_ELEMENTS(flags)] = { NULL };
+  gchar* hashes[G_N_ELEMENTS(flags)] = { NULL };
+  gchar* paths[G_N_ELEMENTS(flags)] = { NULL };
+  GString* output = g_string_new("");
+  GError* err = NULL;
+  gchar* outbase = NULL;
+  gchar* auxname = NULL;
+  gchar* dirname = NULL;
+  guint ran = 0;
+  guint i = 0;
 
-  if (g_find_program_in_path("makeindex")) {
+  outbase = g_strndup(ec->pdffile, strlen(ec->pdffile) - strlen(".pdf"));
+  auxname = g_path_get_basename(outbase);
+  dirname = editor_get_compile_dir(ec);
 
-    gchar* command = g_strdup_printf("%s makeindex \"%s.idx\"",
-                                     C_TEXSEC,
-                                     g_path_get_basename(ec->basename));
+  /* The tools don't depend on each other, start all that are needed
+   * before waiting for any of them */
+  for (i = 0; i < G_N_ELEMENTS(flags); ++i) {
+    gchar* command = NULL;
+    const gchar* chdir = C_TMPDIR;
 
-    Tuple2 res = utils_popen_r(command, C_TMPDIR);
-    retcode = (glong)res.first;
+    if (!(tools & flags[i])) continue;
+    paths[i] = g_strconcat(outbase, inputs[i], NULL);
+    if (!(hashes[i] = latex_get_auxtool_hash(ec, flags[i], paths[i])))
+      continue;
+    if (!force && STR_EQU(hashes[i],
+                          g_hash_table_lookup(lc->auxtool_hashes, paths[i])))
+      continue;
+
+    switch (flags[i]) {
+      case AUX_BIBTEX:
+        command = g_strdup_printf("%s bibtex \"%s\"", C_TEXSEC, outbase);
+        chdir = dirname;
+        break;
+      case AUX_MAKEINDEX:
+        command = g_strdup_printf("%s makeindex \"%s.idx\"", C_TEXSEC,
+                                  auxname);
+        break;
+      case AUX_GLOSSARIES:
+        command = g_strdup_printf("%s makeglossaries \"%s\"", C_TEXSEC,
+                                  auxname);
+        break;
+    }
+    slog(L_DEBUG, "Running %s\n", command);
+    if (!(procs[i] = process_spawn(command, chdir, &err))) {
+      slog(L_ERROR, "%s\n", err->message);
+      g_error_free(err);
+      err = NULL;
+    }
     g_free(command);
   }
-  if (retcode == 0) return TRUE;
+
+  for (i = 0; i < G_N_ELEMENTS(flags); ++i) {
+    if (!procs[i]) continue;
+    gint status = process_wait(procs[i]);
+    /* bibtex exits with 1 if there were only warnings */
+    if (status == 0 ||
+        (flags[i] == AUX_BIBTEX && WEXITSTATUS(status) == 1)) {
+      /* only remember inputs that were processed successfully, so a
+       * failing tool is retried on the next compile */
+      g_hash_table_insert(lc->auxtool_hashes, g_strdup(paths[i]),
+                          g_strdup(hashes[i]));
+      ran |= flags[i];
+    } else {
+      g_hash_table_remove(lc->auxtool_hashes, paths[i]);
+    }
+    g_string_append_len(output, procs[i]->output->str,
+                        procs[i]->output->len);
+    process_free(procs[i]);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS(flags); ++i) {
+    g_free(hashes[i]);
+    g_free(paths[i]);
+  }
+  g_free(lc->auxtool_output);
+  lc->auxtool_output = g_string_free(output, FALSE);
+  g_free(dirname);
+  g_free(auxname);
+  g_free(outbase);
+  return ran;
+}
+
+static gboolean latex_auxtools_active(void)
+{
+  /* rubber and latexmk run these tools themselves */
+  if (rubber_active() || latexmk_active()) return FALSE;
+  if (config_get_value("auxtools")) return TRUE;
   return FALSE;
 }
 
+static gchar* latex_get_auxtool_hash(GuEditor* ec, guint tool,
+                                     const gchar* path)
+{
+  const gchar* programs[] = { "bibtex", "makeindex", "makeglossaries" };
+  gchar* program = NULL;
+  gchar* contents = NULL;
+  gchar* ret = NULL;
+  gsize length = 0;
+  gint index = (tool == AUX_BIBTEX) ? 0 : (tool == AUX_MAKEINDEX) ? 1 : 2;
+
+  /* returns NULL when the tool isn't needed or can't be run */
+  if (!(program = g_find_program_in_path(programs[index]))) return NULL;
+  g_free(program);
+  if (!g_file_get_contents(path, &contents, &length, NULL)) return NULL;
+
+  if (tool == AUX_BIBTEX) {
+    /* only the citations and the databases matter to bibtex */
+    GChecksum* checksum = g_checksum_new(G_CHECKSUM_MD5);
+    gchar** lines = g_strsplit(contents, "\n", -1);
+    gchar* docdir = g_path_get_dirname(ec->filename ? ec->filename
+                                                    : ec->workfile);
+    gboolean needed = FALSE;
+    gint i = 0;
+    GStatBuf st;
+
+    for (i = 0; lines[i]; ++i) {
+      if (g_str_has_prefix(lines[i], "\\citation{") ||
+          g_str_has_prefix(lines[i], "\\bibstyle{")) {
+        g_checksum_update(checksum, (guchar*)lines[i], -1);
+      } else if (g_str_has_prefix(lines[i], "\\bibdata{")) {
+        GSList* bibs = latex_parse_bibdata(lines[i], docdir);
+        GSList* iter = NULL;
+        for (iter = bibs; iter; iter = iter->next) {
+          gchar* stamp = NULL;
+          if (g_stat(iter->data, &st) == 0) {
+            stamp = g_strdup_printf("%s:%ld:%ld", (gchar*)iter->data,
+                                    (glong)st.st_mtime, (glong)st.st_size);
+            g_checksum_update(checksum, (guchar*)stamp, -1);
+          }
+          g_free(stamp);
+        }
+        g_slist_free_full(bibs, g_free);
+        g_checksum_update(checksum, (guchar*)lines[i], -1);
+        needed = TRUE;
+      }
+    }
+    if (needed)
+      ret = g_strdup(g_checksum_get_string(checksum));
+    g_checksum_free(checksum);
+    g_strfreev(lines);
+    g_free(docdir);
+  } else if (length) {
+    ret = g_compute_checksum_for_data(G_CHECKSUM_MD5, (guchar*)contents,
+                                      length);
+  }
+  g_free(contents);
+  return ret;
+}
+
+static GSList* latex_parse_bibdata(const gchar* line, const gchar* docdir)
+{
+  const gchar* start = line + strlen("\\bibdata{");
+  gchar* names = g_strndup(start, strcspn(start, "}"));
+  gchar** bibs = g_strsplit(names, ",", -1);
+  GSList* paths = NULL;
+  gint i = 0;
+
+  /* bibtex runs in the document directory */
+  for (i = 0; bibs[i]; ++i) {
+    gchar* bib = g_strconcat(g_strstrip(bibs[i]), ".bib", NULL);
+    paths = g_slist_prepend(paths, g_path_is_absolute(bib) ? g_strdup(bib)
+                            : g_build_filename(docdir, bib, NULL));
+    g_free(bib);
+  }
+  g_strfreev(bibs);
+  g_free(names);
+  return g_slist_reverse(paths);
+}
+
+GSList* latex_get_bibliography_files(GuEditor* ec)
+{
+  gchar* outbase = g_strndup(ec->pdffile,
+                             strlen(ec->pdffile) - strlen(".pdf"));
+  gchar* docdir = g_path_get_dirname(ec->filename ? ec->filename
+                                                  : ec->workfile);
+  gchar* path = NULL;
+  gchar* contents = NULL;
+  GSList* files = NULL;
+  GSList* iter = NULL;
+  GSList* result = NULL;
+
+  /* the databases bibtex was pointed to by the last compile */
+  path = g_strconcat(outbase, ".aux", NULL);
+  if (g_file_get_contents(path, &contents, NULL, NULL)) {
+    gchar** lines = g_strsplit(contents, "\n", -1);
+    gint i = 0;
+    for (i = 0; lines[i]; ++i) {
+      if (g_str_has_prefix(lines[i], "\\bibdata{"))
+        files = g_slist_concat(files, latex_parse_bibdata(lines[i], docdir));
+    }
+    g_strfreev(lines);
+    g_free(contents);
+    contents = NULL;
+  }
+  g_free(path);
+
+  /* and the ones biblatex lists for biber */
+  path = g_strconcat(outbase, ".bcf", NULL);
+  if (g_file_get_contents(path, &contents, NULL, NULL)) {
+    GRegex* regex = g_regex_new("<bcf:datasource[^>]*>\\s*([^<]+?)\\s*"
+                                "</bcf:datasource>", 0, 0, NULL);
+    GMatchInfo* match_info = NULL;
+    g_regex_match(regex, contents, 0, &match_info);
+    while (g_match_info_matches(match_info)) {
+      gchar* name = g_match_info_fetch(match_info, 1);
+      files = g_slist_append(files, g_path_is_absolute(name) ?
+                             g_strdup(name) :
+                             g_build_filename(docdir, name, NULL));
+      g_free(name);
+      g_match_info_next(match_info, NULL);
+    }
+    g_match_info_free(match_info);
+    g_regex_unref(regex);
+    g_free(contents);
+  }
+  g_free(path);
+
+  for (iter = files; iter; iter = iter->next) {
+    if (utils_path_exists(iter->data))
+      result = g_slist_prepend(result, iter->data);
+    else
+      g_free(iter->data);
+  }
+  g_slist_free(files);
+  g_free(docdir);
+  g_free(outbase);
+  return result;
+}
+
 gboolean latex_can_synctex(void)
 {
   if (gummi->latex->tex_version >= 2008) {
@@ -32,37 +32,168 @@
 
 #include <glib.h>
 
+#include "cache.h"
 #include "editor.h"
+#include "graphics.h"
+#include "logparser.h"
+#include "tikz.h"
 #include "gui/gui-preview.h"
 
+/**
+ * GuCompileProgress:
+ * @pages: number of pages shipped out so far
+ * @file: the input file TeX is reading, or NULL
+ * @elapsed: seconds since the compile started
+ * @previous: duration of the previous compile in seconds, or 0
+ * @first_page: seconds it took to ship out the first page, or 0
+ * @finished: TRUE for the last report of a compile
+ * @graphics_hits: graphics conversions taken from the cache so far
+ * @graphics_misses: graphics that had to be converted so far
+ *
+ * Snapshot of a running compile, posted to the main loop.
+ */
+#define GU_COMPILE_PROGRESS(x) ((GuCompileProgress*)x)
+typedef struct _GuCompileProgress GuCompileProgress;
+
+struct _GuCompileProgress {
+  guint pages;
+  gchar* file;
+  gdouble elapsed;
+  gdouble previous;
+  gdouble first_page;
+  gboolean finished;
+  guint graphics_hits;
+  guint graphics_misses;
+};
+
+/**
+ * GuOverlay:
+ * @file: path of the member relative to the root document
+ * @text: unsaved content of the member
+ *
+ * A project member with unsaved changes, grabbed from its buffer on the
+ * main thread for the compile thread to hand to TeX.
+ */
+#define GU_OVERLAY(x) ((GuOverlay*)x)
+typedef struct _GuOverlay GuOverlay;
+
+struct _GuOverlay {
+  gchar* file;
+  gchar* text;
+};
+
+/* auxiliary tools run in between typesetter passes */
+#define AUX_BIBTEX      (1 << 0)
+#define AUX_MAKEINDEX   (1 << 1)
+#define AUX_GLOSSARIES  (1 << 2)
+#define AUX_ALL         (AUX_BIBTEX | AUX_MAKEINDEX | AUX_GLOSSARIES)
+
 #define GU_LATEX(x) ((GuLatex*)x)
 typedef struct _GuLatex GuLatex;
 
 struct _GuLatex {
   gchar* typesetter;
-  /* use fixed size for errorlines in consider of performance */
-  gint errorlines[BUFSIZ];
   gchar* compilelog;
+  GuLogParser* logparser;
   gboolean modified_since_compile;
 
   int tex_version;
   gboolean compile_status;
+
+  /* the running compile is a quick draft, only set by the compile thread */
+  gboolean draft;
+  /* the running compile may use image proxies */
+  gboolean proxies;
+
+  /* compile results keyed by source, command and dependencies */
+  GuCache* outputcache;
+  gchar* depstamp;
+
+  /* progress of the running compile, only touched by the compile thread */
+  gint64 compile_start;
+  gint64 last_report;
+  guint reported_pages;
+  gchar* reported_file;
+  gdouble first_page;
+  gdouble last_duration;
+
+  /* converted eps and svg graphics */
+  GuGraphics* graphics;
+
+  /* externalized TikZ pictures of the document being compiled */
+  GuTikz* tikz;
+
+  /* unsaved project members handed to TeX in place of their files */
+  gchar* overlaydir;
+  GHashTable* overlays;
+
+  /* TEXINPUTS as it was before Gummi's directories were added, or NULL */
+  gchar* texinputs;
+
+  /* input checksums of the last successful auxiliary tool runs */
+  GHashTable* auxtool_hashes;
+  gchar* auxtool_output;
 };
 
 GuLatex* latex_init(void);
 gboolean latex_precompile_check(gchar* editortext);
 gchar* latex_update_workfile(GuLatex* mc, GuEditor* ec);
+gchar* latex_update_root_workfile(GuLatex* lc, GuEditor* root,
+                                  const gchar* include, GSList* overlays);
+
+/**
+ * latex_grab_overlays:
+ *
+ * Copies the unsaved project members of root, must be called from the
+ * main thread.
+ *
+ * Returns: A newly allocated list of GuOverlay, free it with
+ * latex_free_overlays.
+ */
+GSList* latex_grab_overlays(GuEditor* root);
+void latex_free_overlays(GSList* overlays);
+gboolean latex_includeonly_active(void);
+gboolean latex_draft_active(void);
+gboolean latex_recorder_active(void);
+
+/* latex_get_recorder_file will return a newly allocated string */
+gchar* latex_get_recorder_file(GuEditor* ec);
 void latex_update_pdffile(GuLatex* mc, GuEditor* ec);
 void latex_update_auxfile(GuLatex* mc, GuEditor* ec);
+gboolean latex_focus_active(void);
+
+/**
+ * latex_get_background_command:
+ *
+ * Returns: A newly allocated command that typesets the backgroundfile of
+ * ec into its regular PDF, or NULL if the compile method does not allow
+ * compiling in background.
+ */
+gchar* latex_get_background_command(GuLatex* lc, GuEditor* ec);
+gboolean latex_update_focusfile(GuLatex* lc, GuEditor* ec, const gchar* text,
+                                gint offset);
+gboolean latex_update_focus_pdffile(GuLatex* lc, GuEditor* ec);
 void latex_export_pdffile(GuLatex* lc, GuEditor* ec, const gchar* path,
                           gboolean prompt_overrite);
 
 gboolean latex_typesetter_detected(GuLatex* lc, gchar* typesetter);
 gboolean latex_typesetter_active(gchar* typesetter);
 gboolean latex_method_active(gchar* method);
-gboolean latex_run_makeindex(GuEditor* ec);
+guint latex_run_auxtools(GuLatex* lc, GuEditor* ec, guint tools,
+                         gboolean force);
 int latex_remove_auxfile(GuEditor* ec);
 
+
+/**
+ * latex_get_bibliography_files:
+ *
+ * Returns: A newly allocated list of the newly allocated paths of the
+ * existing databases the last compile of ec asked for, through \bibdata
+ * in its aux file or the datasources of its bcf file. bibtex and biber
+ * read them, so TeX never records them.
+ */
+GSList* latex_get_bibliography_files(GuEditor* ec);
+
 gboolean latex_can_synctex(void);
 gboolean latex_use_synctex(void);
 
@@ -0,0 +1,417 @@
+/**
+ * @file   logparser.c
+ * @brief  streaming parser for typesetter output
+ *
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logparser.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "utils.h"
+
+/* TeX wraps its terminal output after this many characters */
+#define LP_MAX_PRINT_LINE 79
+/* give up looking for the rest of a message after this many lines */
+#define LP_MAX_MESSAGE_LINES 8
+
+enum {
+  LP_NORMAL = 0,
+  LP_AWAIT_CONTEXT,
+  LP_CONTINUE_WARNING
+};
+
+static void logparser_process_line(GuLogParser* lp, gchar* line);
+static void logparser_scan_files(GuLogParser* lp, const gchar* line);
+static const gchar* logparser_file_line_error(const gchar* line,
+                                              gint* lineno, gsize* filelen);
+static gboolean logparser_is_continuation(const gchar* line);
+static void logparser_begin_entry(GuLogParser* lp, LogSeverity severity,
+                                  const gchar* file, gint line,
+                                  const gchar* message);
+static void logparser_end_entry(GuLogParser* lp);
+static void logparser_free_entry(GuLogEntry* entry);
+static void logparser_scan_pages(GuLogParser* lp, const gchar* data,
+                                 gsize len);
+static gint logparser_find_line(const gchar* str, const gchar* marker);
+
+GuLogParser* logparser_new(void)
+{
+  GuLogParser* lp = g_new0(GuLogParser, 1);
+  lp->pending = g_string_new("");
+  lp->linestart = 0;
+  lp->files = NULL;
+  lp->current = NULL;
+  lp->state = LP_NORMAL;
+  lp->lines = 0;
+  lp->inmarker = FALSE;
+  lp->markerdigits = 0;
+  lp->entries = NULL;
+  return lp;
+}
+
+void logparser_reset(GuLogParser* lp)
+{
+  GSList* iter = NULL;
+
+  g_string_truncate(lp->pending, 0);
+  lp->linestart = 0;
+
+  for (iter = lp->files; iter; iter = iter->next)
+    g_free(iter->data);
+  g_slist_free(lp->files);
+  lp->files = NULL;
+
+  if (lp->current) logparser_free_entry(lp->current);
+  lp->current = NULL;
+  lp->state = LP_NORMAL;
+
+  for (iter = lp->entries; iter; iter = iter->next)
+    logparser_free_entry(GU_LOG_ENTRY(iter->data));
+  g_slist_free(lp->entries);
+  lp->entries = NULL;
+
+  lp->nerrors = 0;
+  lp->nwarnings = 0;
+  lp->nbadboxes = 0;
+  lp->npages = 0;
+  lp->inmarker = FALSE;
+  lp->markerdigits = 0;
+}
+
+void logparser_feed(GuLogParser* lp, const gchar* data, gssize len)
+{
+  const gchar* end = NULL;
+  const gchar* nl = NULL;
+
+  if (!data) return;
+  if (len < 0) len = strlen(data);
+  end = data + len;
+
+  /* pages are shipped out in the middle of lines */
+  logparser_scan_pages(lp, data, len);
+
+  while (data < end) {
+    if (!(nl = memchr(data, '\n', end - data))) {
+      g_string_append_len(lp->pending, data, end - data);
+      return;
+    }
+    g_string_append_len(lp->pending, data, nl - data);
+    data = nl + 1;
+
+    if (lp->pending->len > lp->linestart &&
+        lp->pending->str[lp->pending->len - 1] == '\r')
+      g_string_truncate(lp->pending, lp->pending->len - 1);
+
+    /* a line of exactly max_print_line characters continues on the next
+     * one, join them so file names and messages are never split */
+    if (g_utf8_strlen(lp->pending->str + lp->linestart, -1)
+        == LP_MAX_PRINT_LINE) {
+      lp->linestart = lp->pending->len;
+      continue;
+    }
+    logparser_process_line(lp, lp->pending->str);
+    g_string_truncate(lp->pending, 0);
+    lp->linestart = 0;
+  }
+}
+
+void logparser_finish(GuLogParser* lp)
+{
+  if (lp->pending->len) {
+    logparser_process_line(lp, lp->pending->str);
+    g_string_truncate(lp->pending, 0);
+    lp->linestart = 0;
+  }
+  logparser_end_entry(lp);
+  lp->entries = g_slist_reverse(lp->entries);
+}
+
+void logparser_free(GuLogParser* lp)
+{
+  if (!lp) return;
+  logparser_reset(lp);
+  g_string_free(lp->pending, TRUE);
+  g_free(lp);
+}
+
+GSList* logparser_copy_entries(GuLogParser* lp)
+{
+  GSList* copy = NULL;
+  GSList* iter = NULL;
+
+  for (iter = lp->entries; iter; iter = iter->next) {
+    GuLogEntry* entry = GU_LOG_ENTRY(iter->data);
+    GuLogEntry* dup = g_new0(GuLogEntry, 1);
+
+    dup->file = g_strdup(entry->file);
+    dup->line = entry->line;
+    dup->severity = entry->severity;
+    dup->message = g_strdup(entry->message);
+    dup->context = g_strdup(entry->context);
+    copy = g_slist_prepend(copy, dup);
+  }
+  return g_slist_reverse(copy);
+}
+
+void logparser_free_entries(GSList* entries)
+{
+  GSList* iter = NULL;
+
+  for (iter = entries; iter; iter = iter->next)
+    logparser_free_entry(GU_LOG_ENTRY(iter->data));
+  g_slist_free(entries);
+}
+
+gchar* logparser_format_entry(GuLogEntry* entry)
+{
+  const gchar* severity[] = { "Error", "Warning", "Bad box" };
+  gchar* file = entry->file ? g_path_get_basename(entry->file)
+                            : g_strdup("?");
+  gchar* ret = NULL;
+
+  if (entry->line)
+    ret = g_strdup_printf("%s:%d: %s: %s", file, entry->line,
+                          severity[entry->severity], entry->message);
+  else
+    ret = g_strdup_printf("%s: %s: %s", file, severity[entry->severity],
+                          entry->message);
+  g_free(file);
+  return ret;
+}
+
+static void logparser_process_line(GuLogParser* lp, gchar* line)
+{
+  const gchar* message = NULL;
+  gint lineno = 0;
+  gsize filelen = 0;
+
+  if (lp->state == LP_AWAIT_CONTEXT) {
+    /* "l.12 \foo" shows where TeX stopped reading */
+    if (line[0] == 'l' && line[1] == '.' && g_ascii_isdigit(line[2])) {
+      gchar* rest = NULL;
+      lineno = (gint)strtol(line + 2, &rest, 10);
+      if (!lp->current->line) lp->current->line = lineno;
+      lp->current->context = g_strdup(g_strstrip(rest));
+      logparser_end_entry(lp);
+      return;
+    }
+    if (++lp->lines >= LP_MAX_MESSAGE_LINES)
+      logparser_end_entry(lp);
+    else if (line[0] != '!' &&
+             !logparser_file_line_error(line, &lineno, &filelen))
+      return;
+  } else if (lp->state == LP_CONTINUE_WARNING) {
+    if (logparser_is_continuation(line) &&
+        ++lp->lines < LP_MAX_MESSAGE_LINES) {
+      gchar* joined = g_strconcat(lp->current->message, " ",
+                                  g_strstrip(line), NULL);
+      g_free(lp->current->message);
+      lp->current->message = joined;
+      return;
+    }
+    logparser_end_entry(lp);
+  }
+
+  if (line[0] == '!' && line[1] == ' ') {
+    logparser_begin_entry(lp, LOG_ERROR, logparser_current_file(lp), 0,
+                          line + 2);
+    lp->state = LP_AWAIT_CONTEXT;
+  } else if ((message = logparser_file_line_error(line, &lineno, &filelen))) {
+    gchar* file = g_strndup(line, filelen);
+    logparser_begin_entry(lp, LOG_ERROR, file, lineno, message);
+    lp->state = LP_AWAIT_CONTEXT;
+    g_free(file);
+  } else if ((g_str_has_prefix(line, "LaTeX ") ||
+              g_str_has_prefix(line, "Package ") ||
+              g_str_has_prefix(line, "Class ")) &&
+             strstr(line, "Warning: ")) {
+    logparser_begin_entry(lp, LOG_WARNING, logparser_current_file(lp), 0,
+                          line);
+    lp->state = LP_CONTINUE_WARNING;
+  } else if (g_str_has_prefix(line, "Overfull \\") ||
+             g_str_has_prefix(line, "Underfull \\")) {
+    logparser_begin_entry(lp, LOG_BADBOX, logparser_current_file(lp),
+                          logparser_find_line(line, "at line"), line);
+    logparser_end_entry(lp);
+  } else {
+    logparser_scan_files(lp, line);
+  }
+}
+
+static void logparser_scan_pages(GuLogParser* lp, const gchar* data,
+                                 gsize len)
+{
+  gsize i = 0;
+
+  for (i = 0; i < len; ++i) {
+    if (lp->inmarker) {
+      if (g_ascii_isdigit(data[i])) {
+        lp->markerdigits++;
+        continue;
+      }
+      if (lp->markerdigits) lp->npages++;
+      lp->inmarker = FALSE;
+    }
+    if (data[i] == '[') {
+      lp->inmarker = TRUE;
+      lp->markerdigits = 0;
+    }
+  }
+}
+
+static void logparser_scan_files(GuLogParser* lp, const gchar* line)
+{
+  const gchar* pos = line;
+
+  while (*pos) {
+    if (*pos == '(') {
+      const gchar* start = ++pos;
+      while (*pos && *pos != ' ' && *pos != '(' && *pos != ')') ++pos;
+      /* parentheses in plain text are pushed as well, so they still
+       * match up with their closing counterparts */
+      if (pos > start && memchr(start, '.', pos - start))
+        lp->files = g_slist_prepend(lp->files, g_strndup(start, pos - start));
+      else
+        lp->files = g_slist_prepend(lp->files, NULL);
+    } else if (*pos == ')') {
+      if (lp->files) {
+        g_free(lp->files->data);
+        lp->files = g_slist_delete_link(lp->files, lp->files);
+      }
+      ++pos;
+    } else {
+      ++pos;
+    }
+  }
+}
+
+static const gchar* logparser_file_line_error(const gchar* line,
+                                              gint* lineno, gsize* filelen)
+{
+  /* "./file.tex:12: message" as printed with -file-line-error */
+  const gchar* pos = line;
+  const gchar* digits = NULL;
+
+  if (line[0] != '.' && line[0] != '/' && !g_ascii_isalpha(line[0]))
+    return NULL;
+
+  while ((pos = strchr(pos, ':'))) {
+    digits = ++pos;
+    while (g_ascii_isdigit(*pos)) ++pos;
+    if (pos > digits && pos[0] == ':' && pos[1] == ' ') {
+      *lineno = atoi(digits);
+      *filelen = digits - line - 1;
+      return pos + 2;
+    }
+  }
+  return NULL;
+}
+
+static gboolean logparser_is_continuation(const gchar* line)
+{
+  /* package warnings continue with lines prefixed by "(package)" */
+  const gchar* pos = line + 1;
+
+  if (line[0] == ' ') return TRUE;
+  if (line[0] != '(') return FALSE;
+  while (*pos && *pos != ')' && *pos != ' ' && *pos != '.') ++pos;
+  return *pos == ')';
+}
+
+static void logparser_begin_entry(GuLogParser* lp, LogSeverity severity,
+                                  const gchar* file, gint line,
+                                  const gchar* message)
+{
+  GuLogEntry* entry = g_new0(GuLogEntry, 1);
+
+  logparser_end_entry(lp);
+  entry->file = g_strdup(file);
+  entry->line = line;
+  entry->severity = severity;
+  entry->message = g_strdup(message);
+  entry->context = NULL;
+  lp->current = entry;
+  lp->lines = 0;
+}
+
+static void logparser_end_entry(GuLogParser* lp)
+{
+  GuLogEntry* entry = lp->current;
+
+  if (!entry) return;
+
+  switch (entry->severity) {
+    case LOG_ERROR:
+      lp->nerrors++;
+      break;
+    case LOG_WARNING:
+      if (!entry->line)
+        entry->line = logparser_find_line(entry->message, "input line");
+      lp->nwarnings++;
+      break;
+    case LOG_BADBOX:
+      lp->nbadboxes++;
+      break;
+  }
+  lp->entries = g_slist_prepend(lp->entries, entry);
+  lp->current = NULL;
+  lp->state = LP_NORMAL;
+}
+
+static void logparser_free_entry(GuLogEntry* entry)
+{
+  g_free(entry->file);
+  g_free(entry->message);
+  g_free(entry->context);
+  g_free(entry);
+}
+
+const gchar* logparser_current_file(GuLogParser* lp)
+{
+  GSList* iter = NULL;
+
+  for (iter = lp->files; iter; iter = iter->next) {
+    if (iter->data) return (const gchar*)iter->data;
+  }
+  return NULL;
+}
+
+static gint logparser_find_line(const gchar* str, const gchar* marker)
+{
+  /* matches "at line 12", "at lines 12--14" and "on input line 12." */
+  const gchar* pos = strstr(str, marker);
+
+  if (!pos) return 0;
+  pos += strlen(marker);
+  if (*pos == 's') ++pos;
+  while (*pos == ' ') ++pos;
+  return atoi(pos);
+}
@@ -0,0 +1,132 @@
+/**
+ * @file   logparser.h
+ * @brief  streaming parser for typesetter output
+ *
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GUMMI_LOGPARSER_H__
+#define __GUMMI_LOGPARSER_H__
+
+#include <glib.h>
+
+typedef enum _LogSeverity {
+  LOG_ERROR = 0,
+  LOG_WARNING,
+  LOG_BADBOX
+} LogSeverity;
+
+/**
+ * GuLogEntry:
+ * @file: the input file that was open when the message was printed, or
+ * NULL if it could not be determined
+ * @line: the line in @file the message refers to, or 0 if unknown
+ * @severity: the kind of the message
+ * @message: the message text
+ * @context: the source line TeX printed along with an error, or NULL
+ *
+ * A single diagnostic found in the typesetter output.
+ */
+#define GU_LOG_ENTRY(x) ((GuLogEntry*)x)
+typedef struct _GuLogEntry GuLogEntry;
+
+struct _GuLogEntry {
+  gchar* file;
+  gint line;
+  LogSeverity severity;
+  gchar* message;
+  gchar* context;
+};
+
+/**
+ * GuLogParser:
+ *
+ * Parses typesetter output in a single pass while it is being read. Output
+ * can be fed in chunks of any size, complete lines are consumed as soon as
+ * they arrive. The stack of input files is tracked through the `(file` and
+ * `)` markers TeX prints, so every diagnostic is attributed to a file.
+ * Page markers `[1]` are counted as soon as they arrive.
+ */
+#define GU_LOG_PARSER(x) ((GuLogParser*)x)
+typedef struct _GuLogParser GuLogParser;
+
+struct _GuLogParser {
+  /*< private >*/
+  GString* pending;
+  gsize linestart;
+  GSList* files;
+  GuLogEntry* current;
+  gint state;
+  gint lines;
+  gboolean inmarker;
+  gint markerdigits;
+
+  /*< public >*/
+  GSList* entries;
+  guint nerrors;
+  guint nwarnings;
+  guint nbadboxes;
+  guint npages;
+};
+
+GuLogParser* logparser_new(void);
+void logparser_reset(GuLogParser* lp);
+void logparser_feed(GuLogParser* lp, const gchar* data, gssize len);
+
+/**
+ * logparser_finish:
+ *
+ * Flushes the last incomplete line. Must be called once the output is
+ * complete, @entries is in output order afterwards.
+ */
+void logparser_finish(GuLogParser* lp);
+void logparser_free(GuLogParser* lp);
+
+/**
+ * logparser_copy_entries:
+ *
+ * Returns: A deep copy of @entries, to be freed with logparser_free_entries.
+ * The copy stays valid while the parser goes on with the next output.
+ */
+GSList* logparser_copy_entries(GuLogParser* lp);
+void logparser_free_entries(GSList* entries);
+
+/**
+ * logparser_current_file:
+ *
+ * Returns: the innermost input file TeX has open, or NULL
+ */
+const gchar* logparser_current_file(GuLogParser* lp);
+
+/**
+ * logparser_format_entry:
+ *
+ * Returns: A newly allocated "file:line: severity: message" representation
+ * of the entry.
+ */
+gchar* logparser_format_entry(GuLogEntry* entry);
+
+#endif /* __GUMMI_LOGPARSER_H__ */
@@ -52,12 +52,49 @@
 #include "gui/gui-main.h"
 #include "gui/gui-preview.h"
 #include "latex.h"
+#include "process.h"
+#include "project.h"
 #include "snippets.h"
 #include "utils.h"
 
+#include "compile/texlive.h"
+
 extern GummiGui* gui;
 extern Gummi* gummi;
 
+static void motion_terminate_typesetter(GuMotion* m);
+static gboolean motion_dispatch_result(gpointer user);
+static void motion_post_job(GuMotion* mc, gboolean full);
+static gboolean motion_full_build_cb(gpointer user);
+static void motion_on_dependency_changed(gboolean bibliography,
+                                         gpointer user);
+static void motion_compile_job_free(GuCompileJob* job);
+static GuCompileState* motion_state_ref(GuCompileState* state);
+static void motion_state_unref(GuCompileState* state);
+static void motion_background_thread(gpointer data, gpointer user);
+static gboolean motion_background_done(gpointer user);
+static gboolean motion_editor_is_open(GuEditor* ec);
+static void motion_export_result(GuCompileJob* job);
+static gboolean motion_refresh_cb(gpointer user);
+static void motion_run_requested_auxtools(GuLatex* latex, GuEditor* ec,
+                                          GSList* requests);
+static gboolean motion_auxtools_done(gpointer user);
+
+typedef struct {
+  guint tools;
+  GuAuxtoolsFunc func;
+  gpointer user;
+  guint ran;
+  gchar* output;
+} MotionAuxtoolsRequest;
+
+/* weight of the newest sample in the moving averages */
+#define AVERAGE_WEIGHT 0.3
+/* keystrokes further apart than this are pauses, not typing */
+#define TYPING_PAUSE 2.0
+/* compile time in seconds at which waiting for a pause starts to pay off */
+#define SLOW_COMPILE 0.5
+
 /* Typesetter pid */
 pid_t typesetter_pid = 0;
 
@@ -66,12 +103,41 @@ GuMotion* motion_init(void)
   GuMotion* m = g_new0(GuMotion, 1);
 
   m->key_press_timer = 0;
+  m->full_build_timer = 0;
+  m->compile_average = 0;
+  m->typing_average = 0.25;
+  m->last_keystroke = 0;
   g_mutex_init(&m->signal_mutex);
   g_mutex_init(&m->compile_mutex);
   g_cond_init(&m->compile_cv);
   m->keep_running = TRUE;
   m->keep_running = FALSE;
   m->typesetter_pid = &typesetter_pid;
+  m->deptracker = deptracker_new(motion_on_dependency_changed, m);
+  m->workers = NULL;
+
+  if (STR_EQU(config_get_value("adaptive_timer"), ""))
+    config_set_value("adaptive_timer", "True");
+  if (STR_EQU(config_get_value("compile_timer_min"), ""))
+    config_set_value("compile_timer_min", "150");
+  if (STR_EQU(config_get_value("compile_timeout"), ""))
+    config_set_value("compile_timeout", "300");
+  if (STR_EQU(config_get_value("compile_cpu_limit"), ""))
+    config_set_value("compile_cpu_limit", "120");
+  if (STR_EQU(config_get_value("compile_niceness"), ""))
+    config_set_value("compile_niceness", "10");
+  if (STR_EQU(config_get_value("compile_ioclass"), ""))
+    config_set_value("compile_ioclass", "2");
+  if (STR_EQU(config_get_value("compile_cgroup"), ""))
+    config_set_value("compile_cgroup", "False");
+  if (STR_EQU(config_get_value("compile_cpu_weight"), ""))
+    config_set_value("compile_cpu_weight", "50");
+  if (STR_EQU(config_get_value("compile_memory_max"), ""))
+    config_set_value("compile_memory_max", "2G");
+  if (STR_EQU(config_get_value("background_compile"), ""))
+    config_set_value("background_compile", "True");
+  if (STR_EQU(config_get_value("compile_workers"), ""))
+    config_set_value("compile_workers", "0");
 
   return m;
 }
@@ -80,64 +146,78 @@ void motion_start_compile_thread(GuMotion* m)
 {
   m->keep_running = TRUE;
   m->compile_thread = g_thread_new("motion", motion_compile_thread, m);
+
+  if (config_get_value("background_compile")) {
+    gint workers = atoi(config_get_value("compile_workers"));
+
+    /* a quarter of the cores by default, the compile in the foreground
+     * and the preview want the rest */
+    if (workers <= 0) workers = MAX(1, g_get_num_processors() / 4);
+    m->workers = g_thread_pool_new(motion_background_thread, m, workers,
+                                   FALSE, NULL);
+  }
 }
 
 void motion_stop_compile_thread(GuMotion* m)
 {
   L_F_DEBUG;
 
+  g_mutex_lock(&m->signal_mutex);
   m->keep_running = FALSE;
-  motion_do_compile(m);
+  g_cond_signal(&m->compile_cv);
+  g_mutex_unlock(&m->signal_mutex);
   g_thread_join(m->compile_thread);
+
+  /* background compiles still waiting are of no use anymore */
+  if (m->workers) {
+    g_thread_pool_free(m->workers, TRUE, FALSE);
+    m->workers = NULL;
+  }
+
+  /* Don't leave a parked typesetter behind */
+  texlive_warm_stop();
 }
 
 void motion_pause_compile_thread(GuMotion* m)
 {
   L_F_DEBUG;
 
+  g_mutex_lock(&m->signal_mutex);
   m->pause = TRUE;
-  motion_do_compile(m);
+  g_mutex_unlock(&m->signal_mutex);
 }
 
 void motion_resume_compile_thread(GuMotion* m)
 {
   L_F_DEBUG;
 
+  g_mutex_lock(&m->signal_mutex);
   m->pause = FALSE;
+  g_mutex_unlock(&m->signal_mutex);
   motion_do_compile(m);
 }
 
-void motion_kill_typesetter(GuMotion* m)
+static void motion_terminate_typesetter(GuMotion* m)
 {
   if (*m->typesetter_pid) {
-    gchar* command = NULL;
-    /* Kill children spawned by typesetter command/script, don't know
-     * how to do this programatically yet(glib doesn't not provides any
-     * function for killing a process), so use pkill for now. For
-     * win32 there's currently nothing we can do about it. */
-#ifndef WIN32
-    command = g_strdup_printf("pkill -15 -P %d", *m->typesetter_pid);
-    system(command);
-    g_free(command);
-
-    /* Make sure typesetter command is terminated */
-    if (kill(*m->typesetter_pid, 15)) {
-      slog(L_ERROR, "Could not kill process: %s\n",
-           g_strerror(errno));
-    }
-#else
-    if (!TerminateProcess(*m->typesetter_pid, 0)) {
-      gchar *msg = g_win32_error_message(GetLastError());
-      slog(L_ERROR, "Could not kill process: %s\n",
-           msg ? msg : "(null)");
-      g_free(msg);
-    }
-
-#endif
+    /* Results of the current run are useless now, make sure the compile
+     * thread drops them instead of dispatching them to the GUI */
+    g_mutex_lock(&m->signal_mutex);
+    m->cancelled_generation = m->running_generation;
+    g_mutex_unlock(&m->signal_mutex);
 
+    /* takes the children spawned by a typesetter script along */
+    process_terminate(*m->typesetter_pid);
 
     slog(L_DEBUG, "Typeseter[pid=%d]: Killed\n", *m->typesetter_pid);
     *m->typesetter_pid = 0;
+  }
+}
+
+void motion_kill_typesetter(GuMotion* m)
+{
+  if (*m->typesetter_pid) {
+    motion_terminate_typesetter(m);
 
     /* XXX: Ugly hack: delay compile signal */
     motion_start_timer(m);
@@ -147,69 +227,343 @@ void motion_kill_typesetter(GuMotion* m)
 gboolean motion_do_compile(gpointer user)
 {
   L_F_DEBUG;
-  GuMotion* mc = GU_MOTION(user);
+  motion_post_job(GU_MOTION(user), FALSE);
+  return (STR_EQU(config_get_value("compile_scheme"), "real_time"));
+}
 
-  if (!g_mutex_trylock(&mc->signal_mutex)) goto ret;
-  g_cond_signal(&mc->compile_cv);
-  g_mutex_unlock(&mc->signal_mutex);
+static void motion_post_job(GuMotion* mc, gboolean full)
+{
+  GuEditor* editor = gummi_get_active_editor();
+  GuEditor* root = NULL;
+  GuCompileState* state = NULL;
+  GSList* overlays = NULL;
+  gboolean stale = FALSE;
+  GPid background = 0;
+  gint focus = -1;
+
+  /* Any new request postpones the idle full build */
+  if (mc->full_build_timer) {
+    g_source_remove(mc->full_build_timer);
+    mc->full_build_timer = 0;
+  }
 
-ret:
-  return (STR_EQU(config_get_value("compile_scheme"), "real_time"));
+  if (editor) {
+    /* The buffer may only be inspected from the main thread */
+    if (editor->sync_to_last_edit && latex_focus_active())
+      focus = gtk_text_iter_get_offset(&editor->last_edit);
+    if (latex_includeonly_active())
+      root = project_get_root_editor(editor);
+    if (root)
+      overlays = latex_grab_overlays(root);
+    state = root ? root->state : editor->state;
+
+    /* Post a new request, it supersedes any request that is still
+     * waiting in the queue */
+    g_mutex_lock(&mc->signal_mutex);
+    mc->job_full = full || (mc->job_pending && mc->job_full);
+    mc->job_generation++;
+    mc->job_pending = TRUE;
+    mc->job_editor = editor;
+    mc->job_focus = focus;
+    mc->job_root = root;
+    latex_free_overlays(mc->job_overlays);
+    mc->job_overlays = overlays;
+    if (mc->job_state) motion_state_unref(mc->job_state);
+    mc->job_state = motion_state_ref(state);
+
+    /* the foreground takes over from a background compile of the same
+     * document, which would otherwise hold it up */
+    state->cancelled = TRUE;
+    background = state->pid;
+
+    /* A run for an editor that is no longer active will never be shown,
+     * so there is no point in letting it finish. The same goes for a full
+     * compile behind a focus preview, the next one has a fresh preview
+     * ready much sooner */
+    stale = mc->running_editor && (mc->running_editor != editor ||
+                                   mc->running_focused);
+    g_cond_signal(&mc->compile_cv);
+    g_mutex_unlock(&mc->signal_mutex);
+  }
+
+  if (stale) {
+    slog(L_DEBUG, "Cancelling stale compile run\n");
+    motion_terminate_typesetter(mc);
+  }
+  if (background) {
+    slog(L_DEBUG, "Cancelling background compile run\n");
+    process_terminate(background);
+  }
+}
+
+static gboolean motion_full_build_cb(gpointer user)
+{
+  GuMotion* mc = GU_MOTION(user);
+
+  mc->full_build_timer = 0;
+  motion_post_job(mc, TRUE);
+  return FALSE;
 }
 
 gpointer motion_compile_thread(gpointer data)
 {
   L_F_DEBUG;
   GuMotion* mc = GU_MOTION(data);
-  GuEditor* editor = NULL;
   GuLatex* latex = NULL;
-  gboolean precompile_ok = FALSE;
+  GuCompileJob* job = NULL;
+  gboolean cancelled = FALSE;
   gchar *editortext;
 
   latex = gummi_get_latex();
 
   while (TRUE) {
-    if (!g_mutex_trylock(&mc->compile_mutex)) continue;
+    g_mutex_lock(&mc->signal_mutex);
     slog(L_DEBUG, "Compile thread sleeping...\n");
-    g_cond_wait(&mc->compile_cv, &mc->compile_mutex);
+    while (mc->keep_running &&
+           (mc->refresh_pending || !mc->job_pending || mc->pause)) {
+      /* With compile_mutex free the preview can load the PDF the last
+       * job left, before the next one starts writing it again */
+      if (mc->refresh_pending && !mc->refresh_posted) {
+        mc->refresh_posted = TRUE;
+        g_idle_add(motion_refresh_cb, mc);
+      }
+      g_cond_wait(&mc->compile_cv, &mc->signal_mutex);
+    }
     slog(L_DEBUG, "Compile thread awoke.\n");
 
-    if (!(editor = gummi_get_active_editor())) {
-      g_mutex_unlock(&mc->compile_mutex);
-      continue;
-    }
     if (!mc->keep_running) {
-      g_mutex_unlock(&mc->compile_mutex);
-      g_thread_exit(NULL);
+      g_mutex_unlock(&mc->signal_mutex);
+      break;
     }
 
-    if (mc->pause) {
-      g_mutex_unlock(&mc->compile_mutex);
-      continue;
+    /* Take the newest request, everything posted before it is coalesced
+     * into this single run */
+    job = g_new0(GuCompileJob, 1);
+    job->generation = mc->job_generation;
+    job->editor = mc->job_editor;
+    job->focus = mc->job_focus;
+    job->root = mc->job_root;
+    job->overlays = mc->job_overlays;
+    mc->job_overlays = NULL;
+    job->state = mc->job_state;
+    mc->job_state = NULL;
+    if (mc->job_export && mc->job_export_editor == job->editor) {
+      job->export = mc->job_export;
+    } else if (mc->job_export) {
+      slog(L_WARNING, "Dropping export to %s, another document took "
+           "over\n", mc->job_export);
+      g_free(mc->job_export);
+    }
+    mc->job_export = NULL;
+    job->auxtools = mc->job_auxtools;
+    mc->job_auxtools = NULL;
+    job->full = mc->job_full || job->export;
+    job->draft = !job->full && latex_draft_active();
+    mc->job_pending = FALSE;
+    mc->running_generation = job->generation;
+    mc->running_editor = job->editor;
+    mc->running_focused = FALSE;
+    cancelled = FALSE;
+    g_mutex_unlock(&mc->signal_mutex);
+
+    g_mutex_lock(&mc->compile_mutex);
+    g_mutex_lock(&job->state->lock);
+    latex->draft = job->draft;
+    latex->proxies = !job->export && graphics_proxies_active();
+    if (job->root) {
+      /* Project members are typeset as part of the root document */
+      gchar* include = job->full ? NULL :
+                       project_get_include_name(job->root, job->editor);
+      editortext = latex_update_root_workfile(latex, job->root, include,
+                                              job->overlays);
+      g_free(include);
+    } else {
+      editortext = latex_update_workfile(latex, job->editor);
     }
 
-    editortext = latex_update_workfile(latex, editor);
+    job->precompile_ok = latex_precompile_check(editortext);
+    job->texthash = g_compute_checksum_for_string(G_CHECKSUM_MD5,
+                                                  editortext, -1);
+
+    /* the tools the user asked for show in the compile that follows */
+    if (job->auxtools) {
+      if (job->precompile_ok)
+        motion_run_requested_auxtools(latex, job->root ? job->root
+                                                       : job->editor,
+                                      job->auxtools);
+      g_idle_add(motion_auxtools_done, job->auxtools);
+      job->auxtools = NULL;
+    }
 
-    precompile_ok = latex_precompile_check(editortext);
+    /* Typeset only the part around the last edit first, the full document
+     * follows and replaces it once it is done */
+    if (job->precompile_ok && job->focus >= 0 && !job->root &&
+        latex_update_focusfile(latex, job->editor, editortext, job->focus) &&
+        latex_update_focus_pdffile(latex, job->editor)) {
+      *mc->typesetter_pid = 0;
+      g_mutex_lock(&mc->signal_mutex);
+      cancelled = (mc->cancelled_generation == job->generation);
+      mc->running_focused = !cancelled;
+      g_mutex_unlock(&mc->signal_mutex);
+
+      if (!cancelled) {
+        GuCompileJob* preview = g_new0(GuCompileJob, 1);
+        preview->generation = job->generation;
+        preview->editor = job->editor;
+        preview->precompile_ok = TRUE;
+        preview->focused = TRUE;
+        g_idle_add(motion_dispatch_result, preview);
+      }
+    }
     g_free(editortext);
 
-    if (!precompile_ok) {
+    /* The full compile gives way to newer edits */
+    g_mutex_lock(&mc->signal_mutex);
+    if (mc->running_focused && mc->job_pending)
+      mc->cancelled_generation = job->generation;
+    cancelled = (mc->cancelled_generation == job->generation);
+    g_mutex_unlock(&mc->signal_mutex);
+
+    if (job->precompile_ok && !cancelled) {
+      gint64 start = g_get_monotonic_time();
+      latex_update_pdffile(latex, job->root ? job->root : job->editor);
+      job->duration = (gdouble)(g_get_monotonic_time() - start)
+                      / G_USEC_PER_SEC;
+    }
+    /* the next job overwrites these as soon as compile_mutex is free */
+    job->compile_status = latex->compile_status;
+    job->compilelog = g_strdup(latex->compilelog);
+    job->entries = logparser_copy_entries(latex->logparser);
+    *mc->typesetter_pid = 0;
+    g_mutex_unlock(&job->state->lock);
+    g_mutex_unlock(&mc->compile_mutex);
+
+    g_mutex_lock(&mc->signal_mutex);
+    cancelled = (mc->cancelled_generation == job->generation);
+    mc->running_editor = NULL;
+    mc->running_focused = FALSE;
+    /* the request that cancelled this run exports in its place */
+    if (cancelled && job->export && !mc->job_export) {
+      mc->job_export = job->export;
+      mc->job_export_editor = job->editor;
+      job->export = NULL;
+    }
+    g_mutex_unlock(&mc->signal_mutex);
+
+    if (cancelled) {
+      slog(L_DEBUG, "Dropping results of cancelled compile run\n");
+      motion_compile_job_free(job);
+      continue;
+    }
+
+    /* Hand the results over to the main loop, GUI updates must not
+     * happen from this thread */
+    g_idle_add(motion_dispatch_result, job);
+  }
+  return NULL;
+}
+
+static gboolean motion_editor_is_open(GuEditor* ec)
+{
+  GList* tab = NULL;
+
+  for (tab = g_tabs; tab; tab = tab->next) {
+    if (GU_TAB_CONTEXT(tab->data)->editor == ec) return TRUE;
+  }
+  return FALSE;
+}
+
+static void motion_export_result(GuCompileJob* job)
+{
+  GuEditor* ec = job->root ? job->root : job->editor;
+  GError* err = NULL;
+
+  if (!job->precompile_ok || !job->compile_status) {
+    slog(L_G_ERROR, _("Unable to export PDF file.\n\n%s"),
+         _("The document could not be compiled."));
+  } else if (!utils_copy_file(ec->pdffile, job->export, &err)) {
+    slog(L_G_ERROR, _("Unable to export PDF file.\n\n%s"),
+         err->message);
+    g_error_free(err);
+  }
+}
+
+static gboolean motion_dispatch_result(gpointer user)
+{
+  GuCompileJob* job = GU_COMPILE_JOB(user);
+
+  /* the tab may have been closed while the job was on its way */
+  if (!motion_editor_is_open(job->editor) ||
+      (job->root && !motion_editor_is_open(job->root))) {
+    slog(L_DEBUG, "Dropping results of a closed document\n");
+  } else if (job->focused) {
+    g_signal_emit_by_name(gui->previewgui->sig_hook, "document-focused",
+        job->editor);
+  } else if (!job->precompile_ok) {
+    if (job->editor == gummi_get_active_editor())
       g_signal_emit_by_name(gui->previewgui->sig_hook, "document-error",
           "document_error");
-      g_mutex_unlock(&mc->compile_mutex);
-      continue;
+  } else {
+    /* The PDF is complete, the editor can be shown without compiling it
+     * again. Chapters and drafts are not */
+    if (job->compile_status && !job->draft &&
+        (!job->root || job->full) && job->state->editor) {
+      g_free(job->state->texthash);
+      job->state->texthash = g_strdup(job->texthash);
     }
 
-    latex_update_pdffile(latex, editor);
-    *mc->typesetter_pid = 0;
-    g_mutex_unlock(&mc->compile_mutex);
+    /* full builds are not what the user waits for after typing */
+    if (!job->full && job->duration > 0) {
+      gummi->motion->compile_average =
+          AVERAGE_WEIGHT * job->duration +
+          (1 - AVERAGE_WEIGHT) * gummi->motion->compile_average;
+    }
 
-    if (!mc->keep_running)
-      g_thread_exit(NULL);
+    /* follow the files the shown document was built from */
+    if (job->editor == gummi_get_active_editor()) {
+      if (latex_recorder_active()) {
+        GuEditor* ec = job->root ? job->root : job->editor;
+        gchar* flsfile = latex_get_recorder_file(ec);
+        GSList* bibliographies = latex_get_bibliography_files(ec);
+        deptracker_update(gummi->motion->deptracker, flsfile,
+                          bibliographies);
+        g_slist_free_full(bibliographies, g_free);
+        g_free(flsfile);
+      } else {
+        deptracker_clear(gummi->motion->deptracker);
+      }
+    }
 
     g_signal_emit_by_name(gui->previewgui->sig_hook, "document-compiled",
-        editor);
+        job);
+
+    /* Bring the chapters that were left out and the images of a draft up
+     * to date once the user stops typing */
+    if ((job->root || job->draft) && !job->full &&
+        !gummi->motion->full_build_timer)
+      gummi->motion->full_build_timer = g_timeout_add_seconds(
+          atoi(config_get_value("full_build_delay")),
+          motion_full_build_cb, gummi->motion);
   }
+  if (job->export && motion_editor_is_open(job->editor) &&
+      (!job->root || motion_editor_is_open(job->root)))
+    motion_export_result(job);
+  motion_compile_job_free(job);
+
+  /* the other tabs may have changed meanwhile */
+  motion_queue_backgrounds(gummi->motion);
+  return FALSE;
+}
+
+static void motion_compile_job_free(GuCompileJob* job)
+{
+  if (job->state) motion_state_unref(job->state);
+  latex_free_overlays(job->overlays);
+  g_free(job->texthash);
+  g_free(job->compilelog);
+  logparser_free_entries(job->entries);
+  g_free(job->export);
+  g_free(job);
 }
 
 void motion_force_compile(GuMotion *mc)
@@ -217,7 +571,110 @@ void motion_force_compile(GuMotion *mc)
   /* sort-of signal to force a compile run after certain actions that
    * don't trigger the regular editor content change signals */
   gummi->latex->modified_since_compile = TRUE;
-  motion_do_compile(mc);
+  motion_post_job(mc, TRUE);
+}
+
+void motion_defer_refresh(GuMotion* mc)
+{
+  g_mutex_lock(&mc->signal_mutex);
+  mc->refresh_pending = TRUE;
+  g_cond_signal(&mc->compile_cv);
+  g_mutex_unlock(&mc->signal_mutex);
+}
+
+static gboolean motion_refresh_cb(gpointer user)
+{
+  GuMotion* mc = GU_MOTION(user);
+
+  previewgui_refresh_deferred(gui->previewgui);
+
+  g_mutex_lock(&mc->signal_mutex);
+  mc->refresh_pending = FALSE;
+  mc->refresh_posted = FALSE;
+  g_cond_signal(&mc->compile_cv);
+  g_mutex_unlock(&mc->signal_mutex);
+  return FALSE;
+}
+
+void motion_run_auxtools(GuMotion* mc, guint tools, GuAuxtoolsFunc func,
+                         gpointer user)
+{
+  MotionAuxtoolsRequest* request = g_new0(MotionAuxtoolsRequest, 1);
+
+  request->tools = tools;
+  request->func = func;
+  request->user = user;
+  g_mutex_lock(&mc->signal_mutex);
+  mc->job_auxtools = g_slist_append(mc->job_auxtools, request);
+  g_mutex_unlock(&mc->signal_mutex);
+  motion_force_compile(mc);
+}
+
+static void motion_run_requested_auxtools(GuLatex* latex, GuEditor* ec,
+                                          GSList* requests)
+{
+  GSList* iter = NULL;
+  gchar* auxname = NULL;
+  guint tools = 0;
+  guint ran = 0;
+
+  for (iter = requests; iter; iter = iter->next)
+    tools |= ((MotionAuxtoolsRequest*)iter->data)->tools;
+
+  /* bibtex reads the citations from the aux file the last compile left
+   * behind, only typeset a first time when there is none yet */
+  auxname = g_strdup(ec->pdffile);
+  strcpy(auxname + strlen(auxname) - 4, ".aux");
+  if ((tools & AUX_BIBTEX) && !g_file_test(auxname, G_FILE_TEST_EXISTS))
+    latex_update_auxfile(latex, ec);
+  g_free(auxname);
+
+  ran = latex_run_auxtools(latex, ec, tools, TRUE);
+  for (iter = requests; iter; iter = iter->next) {
+    MotionAuxtoolsRequest* request = (MotionAuxtoolsRequest*)iter->data;
+    request->ran = ran & request->tools;
+    request->output = g_strdup(latex->auxtool_output);
+  }
+}
+
+static gboolean motion_auxtools_done(gpointer user)
+{
+  GSList* requests = (GSList*)user;
+  GSList* iter = NULL;
+
+  for (iter = requests; iter; iter = iter->next) {
+    MotionAuxtoolsRequest* request = (MotionAuxtoolsRequest*)iter->data;
+    if (request->func)
+      request->func(request->ran, request->output ? request->output : "",
+                    request->user);
+    g_free(request->output);
+    g_free(request);
+  }
+  g_slist_free(requests);
+  return FALSE;
+}
+
+void motion_export_pdf(GuMotion* mc, GuEditor* ec, const gchar* path)
+{
+  g_mutex_lock(&mc->signal_mutex);
+  g_free(mc->job_export);
+  mc->job_export = g_strdup(path);
+  mc->job_export_editor = ec;
+  g_mutex_unlock(&mc->signal_mutex);
+  motion_force_compile(mc);
+}
+
+static void motion_on_dependency_changed(gboolean bibliography,
+                                         gpointer user)
+{
+  slog(L_DEBUG, "Dependencies changed%s, recompiling\n",
+       bibliography ? " (bibliography)" : "");
+  /* a changed database needs bibtex, the other tools are left to the
+   * checksums over their inputs */
+  if (bibliography)
+    motion_run_auxtools(GU_MOTION(user), AUX_BIBTEX, NULL, NULL);
+  else
+    motion_force_compile(GU_MOTION(user));
 }
 
 gboolean motion_idle_cb(gpointer user)
@@ -227,11 +684,29 @@ gboolean motion_idle_cb(gpointer user)
   return FALSE;
 }
 
+guint motion_get_delay(GuMotion* mc)
+{
+  guint longest = MAX(atoi(config_get_value("compile_timer")), 1) * 1000;
+  guint shortest = MIN((guint)MAX(atoi(config_get_value(
+                         "compile_timer_min")), 0), longest);
+  gdouble slowness = 0, delay = 0;
+
+  if (!config_get_value("adaptive_timer")) return longest;
+
+  /* A fast document is compiled right away, an aborted compile costs
+   * next to nothing. A slow one waits for a pause in the typing, as a
+   * compile started in between keystrokes is thrown away anyway */
+  slowness = mc->compile_average / (mc->compile_average + SLOW_COMPILE);
+  delay = slowness * (2 * mc->typing_average + mc->compile_average / 2);
+
+  return CLAMP(shortest + (guint)(delay * 1000), shortest, longest);
+}
+
 void motion_start_timer(GuMotion* mc)
 {
   motion_stop_timer(mc);
-  mc->key_press_timer = g_timeout_add_seconds(atoi(
-                          config_get_value("compile_timer")), motion_idle_cb, mc);
+  mc->key_press_timer = g_timeout_add(motion_get_delay(mc),
+                                      motion_idle_cb, mc);
 }
 
 void motion_stop_timer(GuMotion* mc)
@@ -244,8 +719,17 @@ void motion_stop_timer(GuMotion* mc)
 
 gboolean on_key_press_cb(GtkWidget* widget, GdkEventKey* event, void* user)
 {
+  GuMotion* mc = GU_MOTION(user);
+
   if (!event->is_modifier) {
-    motion_stop_timer(GU_MOTION(user));
+    gint64 now = g_get_monotonic_time();
+    gdouble interval = (gdouble)(now - mc->last_keystroke) / G_USEC_PER_SEC;
+    if (mc->last_keystroke && interval < TYPING_PAUSE) {
+      mc->typing_average = AVERAGE_WEIGHT * interval +
+                           (1 - AVERAGE_WEIGHT) * mc->typing_average;
+    }
+    mc->last_keystroke = now;
+    motion_stop_timer(mc);
   }
   if (config_get_value("snippets") &&
       snippets_key_press_cb(gummi_get_snippets(),
@@ -265,3 +749,204 @@ gboolean on_key_release_cb(GtkWidget* widget, GdkEventKey* event, void* user)
     return TRUE;
   return FALSE;
 }
+
+GuCompileState* motion_state_new(GuEditor* ec)
+{
+  GuCompileState* state = g_new0(GuCompileState, 1);
+
+  state->refcount = 1;
+  g_mutex_init(&state->lock);
+  state->editor = ec;
+  state->texthash = NULL;
+  state->dirty = TRUE;
+  state->queued = FALSE;
+  state->pid = 0;
+  state->cancelled = FALSE;
+
+  return state;
+}
+
+static GuCompileState* motion_state_ref(GuCompileState* state)
+{
+  g_atomic_int_inc(&state->refcount);
+  return state;
+}
+
+static void motion_state_unref(GuCompileState* state)
+{
+  if (!g_atomic_int_dec_and_test(&state->refcount)) return;
+  g_mutex_clear(&state->lock);
+  g_free(state->texthash);
+  g_free(state->failedhash);
+  g_free(state);
+}
+
+void motion_state_release(GuCompileState* state)
+{
+  GuMotion* mc = gummi->motion;
+  GPid pid = 0;
+
+  state->editor = NULL;
+  g_mutex_lock(&mc->signal_mutex);
+  state->cancelled = TRUE;
+  pid = state->pid;
+  g_mutex_unlock(&mc->signal_mutex);
+
+  if (pid) process_terminate(pid);
+  motion_state_unref(state);
+}
+
+void motion_queue_background(GuMotion* mc, GuEditor* ec)
+{
+  GuCompileState* state = ec->state;
+  GuBackgroundJob* job = NULL;
+  gchar* command = NULL;
+  gchar* text = NULL;
+  gchar* hash = NULL;
+
+  if (!mc->workers || !state->dirty || state->queued ||
+      ec == gummi_get_active_editor() || !ec->pdffile)
+    return;
+  if (!(command = latex_get_background_command(gummi->latex, ec))) return;
+
+  /* The text is grabbed and hashed once per change of the buffer, not
+   * after every compile of the foreground */
+  state->dirty = FALSE;
+
+  /* Only documents of their own, project members are typeset as part of
+   * their root document */
+  text = editor_grab_buffer(ec);
+  hash = g_compute_checksum_for_string(G_CHECKSUM_MD5, text, -1);
+  /* A failure is retried once the text changed. Graphics are only
+   * converted for the document in the foreground */
+  if (STR_EQU(hash, state->texthash) || STR_EQU(hash, state->failedhash) ||
+      !utils_subinstr("\\begin{document}", text, FALSE) ||
+      graphics_needs_conversion(ec, text)) {
+    g_free(command);
+    g_free(text);
+    g_free(hash);
+    return;
+  }
+
+  job = g_new0(GuBackgroundJob, 1);
+  job->state = motion_state_ref(state);
+  job->text = text;
+  job->texthash = hash;
+  job->workfile = g_strdup(ec->backgroundfile);
+  job->command = command;
+  job->curdir = editor_get_compile_dir(ec);
+  job->wall_limit = atoi(config_get_value("compile_timeout"));
+  job->cpu_limit = atoi(config_get_value("compile_cpu_limit"));
+
+  state->queued = TRUE;
+  g_mutex_lock(&mc->signal_mutex);
+  state->cancelled = FALSE;
+  g_mutex_unlock(&mc->signal_mutex);
+
+  slog(L_DEBUG, "Queueing background compile of %s\n", ec->workfile);
+  g_thread_pool_push(mc->workers, job, NULL);
+}
+
+void motion_queue_backgrounds(GuMotion* mc)
+{
+  GList* tab = NULL;
+
+  for (tab = g_tabs; tab; tab = tab->next)
+    motion_queue_background(mc, GU_TAB_CONTEXT(tab->data)->editor);
+}
+
+gboolean motion_pdf_is_current(GuEditor* ec)
+{
+  gchar* text = NULL;
+  gchar* hash = NULL;
+  gboolean current = FALSE;
+
+  if (!ec->state->texthash || !utils_path_exists(ec->pdffile)) return FALSE;
+
+  text = editor_grab_buffer(ec);
+  hash = g_compute_checksum_for_string(G_CHECKSUM_MD5, text, -1);
+  current = STR_EQU(hash, ec->state->texthash);
+  g_free(text);
+  g_free(hash);
+  return current;
+}
+
+static void motion_background_thread(gpointer data, gpointer user)
+{
+  GuBackgroundJob* job = GU_BACKGROUND_JOB(data);
+  GuMotion* mc = GU_MOTION(user);
+  GuProcess* proc = NULL;
+  GError* err = NULL;
+  gboolean cancelled = FALSE;
+  /* at the lowest priority there is, the foreground goes first */
+  GuSpawnPolicy policy = { 19, 3 };
+
+  g_mutex_lock(&job->state->lock);
+  g_mutex_lock(&mc->signal_mutex);
+  cancelled = job->state->cancelled;
+  g_mutex_unlock(&mc->signal_mutex);
+
+  if (!cancelled && utils_set_file_contents(job->workfile, job->text, -1)) {
+    if (!(proc = process_spawn_full(job->command, job->curdir, &policy,
+                                    &err))) {
+      slog(L_ERROR, "Could not start background compile: %s\n",
+           err->message);
+      g_error_free(err);
+    } else {
+      g_mutex_lock(&mc->signal_mutex);
+      job->state->pid = proc->pid;
+      cancelled = job->state->cancelled;
+      g_mutex_unlock(&mc->signal_mutex);
+      if (cancelled) process_terminate(proc->pid);
+
+      proc->wall_limit = job->wall_limit;
+      proc->cpu_limit = job->cpu_limit;
+      job->ok = process_wait(proc) == 0 && !proc->timed_out;
+      process_free(proc);
+
+      g_mutex_lock(&mc->signal_mutex);
+      job->state->pid = 0;
+      g_mutex_unlock(&mc->signal_mutex);
+    }
+  }
+  g_mutex_lock(&mc->signal_mutex);
+  job->cancelled = job->state->cancelled;
+  job->ok = job->ok && !job->cancelled;
+  g_mutex_unlock(&mc->signal_mutex);
+  g_mutex_unlock(&job->state->lock);
+
+  g_idle_add(motion_background_done, job);
+}
+
+static gboolean motion_background_done(gpointer user)
+{
+  GuBackgroundJob* job = GU_BACKGROUND_JOB(user);
+  GuCompileState* state = job->state;
+
+  state->queued = FALSE;
+  if (job->ok && state->editor) {
+    slog(L_DEBUG, "Background compile of %s done\n",
+         state->editor->workfile);
+    g_free(state->texthash);
+    state->texthash = job->texthash;
+    job->texthash = NULL;
+  } else if (state->editor && !job->cancelled) {
+    slog(L_DEBUG, "Background compile of %s failed\n",
+         state->editor->workfile);
+    g_free(state->failedhash);
+    state->failedhash = job->texthash;
+    job->texthash = NULL;
+  } else {
+    /* the text was never typeset, look at it again */
+    state->dirty = TRUE;
+  }
+
+  motion_state_unref(state);
+  g_free(job->text);
+  g_free(job->texthash);
+  g_free(job->workfile);
+  g_free(job->command);
+  g_free(job->curdir);
+  g_free(job);
+  return FALSE;
+}
@@ -33,16 +33,153 @@
 #include <glib.h>
 #include <gtk/gtk.h>
 
+#include "deptracker.h"
+
 #define GU_MOTION(x) ((GuMotion*)x)
 typedef struct _GuMotion GuMotion;
 
+/**
+ * GuCompileState:
+ *
+ * Compile state of an editor, it outlives the editor while a compile of
+ * it is still in flight. @lock is held by whichever thread works on the
+ * files of the editor. @texthash is the checksum of the text the PDF of
+ * the editor was last built from and @queued is set while a background
+ * compile is pending, both belong to the main thread, as does @editor,
+ * which is NULL once the editor is gone, and @failedhash, the checksum of
+ * a text whose background compile failed. @dirty is set by the "changed"
+ * signal of the buffer and cleared once motion_queue_background looked at
+ * the text, it belongs to the main thread as well. @pid and @cancelled
+ * belong to the background compile and are protected by signal_mutex.
+ */
+#define GU_COMPILE_STATE(x) ((GuCompileState*)x)
+typedef struct _GuCompileState GuCompileState;
+
+struct _GuCompileState {
+  gint refcount;
+  GMutex lock;
+  struct _GuEditor* editor;
+  gchar* texthash;
+  gchar* failedhash;
+  gboolean dirty;
+  gboolean queued;
+  GPid pid;
+  gboolean cancelled;
+};
+
+/**
+ * GuBackgroundJob:
+ *
+ * A compile of an editor that is not in the foreground, run by one of the
+ * workers. Everything it needs is taken from the editor on the main thread
+ * beforehand, so the workers never touch the editor itself.
+ */
+#define GU_BACKGROUND_JOB(x) ((GuBackgroundJob*)x)
+typedef struct _GuBackgroundJob GuBackgroundJob;
+
+struct _GuBackgroundJob {
+  GuCompileState* state;
+  gchar* text;
+  gchar* texthash;
+  gchar* workfile;
+  gchar* command;
+  gchar* curdir;
+  gint wall_limit;
+  gint cpu_limit;
+  gboolean ok;
+  gboolean cancelled;
+};
+
+/**
+ * GuCompileJob:
+ *
+ * A compile request as handed from the main thread to the compile thread.
+ * Every request is stamped with a generation number, a newer request simply
+ * replaces an older one that has not been picked up yet. @focus is the
+ * character offset of the last edit for the focus preview, or -1. Members
+ * of a project are built through @root, limited to the chapter being
+ * edited unless @full is set. A @draft build leaves out images and synctex.
+ * @duration is the time the compile took in seconds. @state belongs to the
+ * editor whose files are written and @texthash is the checksum of its text.
+ * @compile_status, @compilelog and the parsed log @entries are copied from
+ * the GuLatex before the compile thread lets go of it, the main loop only
+ * reads them from here. A job with @export set is built without image
+ * proxies and its PDF is copied there once the result is dispatched.
+ * @auxtools are the requests of motion_run_auxtools it runs ahead of the
+ * compile.
+ */
+#define GU_COMPILE_JOB(x) ((GuCompileJob*)x)
+typedef struct _GuCompileJob GuCompileJob;
+
+/**
+ * GuAuxtoolsFunc:
+ *
+ * Called from the main loop with the AUX_* flags of the requested tools
+ * that ran successfully and the output of all of them.
+ */
+typedef void (*GuAuxtoolsFunc)(guint ran, const gchar* output,
+                               gpointer user);
+
+struct _GuCompileJob {
+  guint64 generation;
+  struct _GuEditor* editor;
+  struct _GuEditor* root;
+  GSList* overlays;
+  gint focus;
+  gboolean full;
+  gboolean draft;
+  gboolean precompile_ok;
+  gboolean focused;
+  gdouble duration;
+  GuCompileState* state;
+  gchar* texthash;
+  gboolean compile_status;
+  gchar* compilelog;
+  GSList* entries;
+  gchar* export;
+  GSList* auxtools;
+};
+
 struct _GuMotion {
   gint key_press_timer;
+
+  /* moving averages in seconds the compile delay is derived from, only
+   * touched by the main thread */
+  gdouble compile_average;
+  gdouble typing_average;
+  gint64 last_keystroke;
+
   GMutex signal_mutex;
   GMutex compile_mutex;
   GThread* compile_thread;
   GCond compile_cv;
   pid_t* typesetter_pid;
+  GuDepTracker* deptracker;
+
+  /* compiles of the editors in the background tabs */
+  GThreadPool* workers;
+
+  /* Job queue, all fields below are protected by signal_mutex */
+  guint64 job_generation;
+  gboolean job_pending;
+  struct _GuEditor* job_editor;
+  gint job_focus;
+  struct _GuEditor* job_root;
+  GSList* job_overlays;
+  GuCompileState* job_state;
+  gboolean job_full;
+  gchar* job_export;
+  struct _GuEditor* job_export_editor;
+  GSList* job_auxtools;
+  guint full_build_timer;
+  guint64 running_generation;
+  guint64 cancelled_generation;
+  struct _GuEditor* running_editor;
+  gboolean running_focused;
+  /* a preview refresh found compile_mutex taken and waits for the compile
+   * thread to let go of it between two jobs */
+  gboolean refresh_pending;
+  gboolean refresh_posted;
 
   gboolean keep_running;
   gboolean pause;
@@ -56,12 +193,67 @@ void motion_pause_compile_thread(GuMotion* m);
 void motion_resume_compile_thread(GuMotion* m);
 gboolean motion_do_compile(gpointer user);
 void motion_force_compile(GuMotion *mc);
+
+/**
+ * motion_defer_refresh:
+ *
+ * Asks the compile thread to hold off its next job until the preview was
+ * refreshed, which previewgui_refresh_deferred does from the main loop.
+ */
+void motion_defer_refresh(GuMotion* mc);
+
+/**
+ * motion_export_pdf:
+ *
+ * Queues a full compile of ec without drafts or image proxies and copies
+ * its PDF to path once it is done.
+ */
+void motion_export_pdf(GuMotion* mc, struct _GuEditor* ec,
+                       const gchar* path);
+
+/**
+ * motion_run_auxtools:
+ *
+ * Queues a forced run of the AUX_* tools for the active document on the
+ * compile thread, which owns its auxiliary files, followed by a full
+ * compile that shows their output. func is called from the main loop once
+ * the tools ran.
+ */
+void motion_run_auxtools(GuMotion* mc, guint tools, GuAuxtoolsFunc func,
+                         gpointer user);
 gpointer motion_compile_thread(gpointer data);
 gboolean motion_idle_cb(gpointer user);
+guint motion_get_delay(GuMotion* mc);
 void motion_start_timer(GuMotion* mc);
 void motion_stop_timer(GuMotion* mc);
 void motion_kill_typesetter(GuMotion* m);
 
+GuCompileState* motion_state_new(struct _GuEditor* ec);
+
+/**
+ * motion_state_release:
+ *
+ * Detaches the state from its editor, which is about to be destroyed, and
+ * cancels its background compile.
+ */
+void motion_state_release(GuCompileState* state);
+
+/**
+ * motion_queue_background:
+ *
+ * Queues a compile of ec, which is not the active editor, in the workers
+ * if its text changed since its PDF was last built.
+ */
+void motion_queue_background(GuMotion* mc, struct _GuEditor* ec);
+void motion_queue_backgrounds(GuMotion* mc);
+
+/**
+ * motion_pdf_is_current:
+ *
+ * Returns: TRUE if the PDF of ec was built from the text it has now.
+ */
+gboolean motion_pdf_is_current(struct _GuEditor* ec);
+
 gboolean on_key_press_cb(GtkWidget* widget, GdkEventKey* event, void* user);
 gboolean on_key_release_cb(GtkWidget* widget, GdkEventKey* event, void* user);
 
@@ -0,0 +1,481 @@
+/**
+ * @file   process.c
+ * @brief  subprocess output capture
+ *
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "process.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "configfile.h"
+#include "external.h"
+#include "utils.h"
+
+static void process_append(GuProcess* proc, const gchar* data, gsize len);
+static void process_close_channel(GuProcess* proc);
+static gboolean process_on_output(GIOChannel* channel, GIOCondition cond,
+                                  gpointer user);
+static void process_on_exit(GPid pid, gint status, gpointer user);
+static void process_check_finished(GuProcess* proc);
+#ifndef WIN32
+static gboolean process_on_kill_timeout(gpointer user);
+static void process_read_watched(GuProcess* proc);
+static gdouble process_get_cpu_time(GPid pid);
+#endif
+
+/* milliseconds a terminated process group gets before it is killed */
+#define PROCESS_KILL_DELAY 2000
+/* milliseconds between two checks of the limits of a running process */
+#define PROCESS_WATCH_INTERVAL 250
+
+/* Process groups process_terminate is about to kill, with the source of
+ * their SIGKILL, until their leader is reaped */
+static GHashTable* terminating = NULL;
+static GMutex terminating_mutex;
+
+/* ioprio_set(2) arguments, glibc has no wrapper for it */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_LOWEST 7
+
+GuProcess* process_spawn(const gchar* cmd, const gchar* chdir, GError** err)
+{
+  return process_spawn_full(cmd, chdir, NULL, err);
+}
+
+GuProcess* process_spawn_full(const gchar* cmd, const gchar* chdir,
+                              GuSpawnPolicy* policy, GError** err)
+{
+  GPid pid = 0;
+  gint pout = 0;
+  gchar** args = NULL;
+
+  g_assert(cmd != NULL);
+
+  if (!g_shell_parse_argv(cmd, NULL, &args, err))
+    return NULL;
+
+  if (!g_spawn_async_with_pipes(chdir, args, NULL,
+                                G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                                process_setup_child, policy, &pid, NULL,
+                                &pout, NULL, err)) {
+    g_strfreev(args);
+    return NULL;
+  }
+  g_strfreev(args);
+
+  return process_new(pid, pout);
+}
+
+void process_get_policy(GuSpawnPolicy* policy)
+{
+  gint ioclass = atoi(config_get_value("compile_ioclass"));
+
+  policy->niceness = CLAMP(atoi(config_get_value("compile_niceness")), 0, 19);
+  /* best effort or idle, the realtime class would starve everything else
+   * on the disk */
+  policy->ioclass = (ioclass == 2 || ioclass == 3) ? ioclass : 0;
+}
+
+void process_setup_child(gpointer user)
+{
+#ifndef WIN32
+  GuSpawnPolicy* policy = (GuSpawnPolicy*)user;
+
+  setsid();
+
+  /* Only plain system calls in here, the child is a copy of a threaded
+   * process and may not allocate */
+  if (!policy) return;
+  if (policy->niceness > 0)
+    setpriority(PRIO_PROCESS, 0, getpriority(PRIO_PROCESS, 0) +
+                                 policy->niceness);
+#ifdef __linux__
+  if (policy->ioclass > 0)
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+            (policy->ioclass << IOPRIO_CLASS_SHIFT) |
+            (policy->ioclass == 2 ? IOPRIO_LOWEST : 0));
+#endif
+#endif
+}
+
+gchar* process_wrap_command(const gchar* cmd)
+{
+#ifdef __linux__
+  static gint available = -1;
+
+  if (!config_get_value("compile_cgroup")) return g_strdup(cmd);
+
+  /* scopes are made by the systemd user instance on the unified hierarchy */
+  if (available < 0) {
+    available = external_exists("systemd-run") &&
+                g_file_test("/sys/fs/cgroup/cgroup.controllers",
+                            G_FILE_TEST_EXISTS);
+    if (!available)
+      slog(L_WARNING, "Compiles can not be put in a cgroup, systemd-run "
+           "or cgroup v2 is missing\n");
+  }
+  if (!available) return g_strdup(cmd);
+
+  /* systemd-run executes cmd in place, the pid stays the same */
+  gchar* weight = g_shell_quote(config_get_value("compile_cpu_weight"));
+  gchar* memory = g_shell_quote(config_get_value("compile_memory_max"));
+  gchar* wrapped = g_strdup_printf("systemd-run --user --scope --quiet "
+                                   "--collect -p CPUWeight=%s "
+                                   "-p MemoryMax=%s %s",
+                                   weight, memory, cmd);
+  g_free(weight);
+  g_free(memory);
+  return wrapped;
+#else
+  return g_strdup(cmd);
+#endif
+}
+
+void process_terminate(GPid pid)
+{
+#ifndef WIN32
+  /* The process leads its own group, scripts and the tools they run are
+   * in there with it */
+  if (kill(-pid, SIGTERM) && kill(pid, SIGTERM)) {
+    slog(L_ERROR, "Could not kill process: %s\n", g_strerror(errno));
+    return;
+  }
+  g_mutex_lock(&terminating_mutex);
+  if (!terminating)
+    terminating = g_hash_table_new(g_direct_hash, g_direct_equal);
+  if (!g_hash_table_contains(terminating, GINT_TO_POINTER(pid))) {
+    guint source = g_timeout_add(PROCESS_KILL_DELAY, process_on_kill_timeout,
+                                 GINT_TO_POINTER(pid));
+    g_hash_table_insert(terminating, GINT_TO_POINTER(pid),
+                        GUINT_TO_POINTER(source));
+  }
+  g_mutex_unlock(&terminating_mutex);
+#else
+  if (!TerminateProcess(pid, 0)) {
+    gchar *msg = g_win32_error_message(GetLastError());
+    slog(L_ERROR, "Could not kill process: %s\n", msg ? msg : "(null)");
+    g_free(msg);
+  }
+#endif
+}
+
+#ifndef WIN32
+static gboolean process_on_kill_timeout(gpointer user)
+{
+  GPid pid = GPOINTER_TO_INT(user);
+  siginfo_t info;
+
+  /* Once its leader is reaped the id of the group may be taken by an
+   * unrelated process. Until then it is an unreaped child of ours */
+  g_mutex_lock(&terminating_mutex);
+  memset(&info, 0, sizeof(info));
+  if (g_hash_table_remove(terminating, user) &&
+      waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 &&
+      kill(-pid, SIGKILL) == 0) {
+    /* nothing left of the group is the common case */
+    slog(L_DEBUG, "Process group %d did not terminate, killed\n", pid);
+  }
+  g_mutex_unlock(&terminating_mutex);
+  return FALSE;
+}
+#endif
+
+void process_forget(GPid pid)
+{
+#ifndef WIN32
+  gpointer source = NULL;
+
+  g_mutex_lock(&terminating_mutex);
+  if (terminating &&
+      (source = g_hash_table_lookup(terminating, GINT_TO_POINTER(pid)))) {
+    g_source_remove(GPOINTER_TO_UINT(source));
+    g_hash_table_remove(terminating, GINT_TO_POINTER(pid));
+  }
+  g_mutex_unlock(&terminating_mutex);
+#endif
+}
+
+GuProcess* process_new(GPid pid, gint fd)
+{
+  GuProcess* p = g_new0(GuProcess, 1);
+
+  p->pid = pid;
+  p->output = g_string_sized_new(BUFSIZ);
+  p->status = 0;
+  p->wall_limit = 0;
+  p->cpu_limit = 0;
+  p->timed_out = FALSE;
+#ifdef WIN32
+  p->channel = g_io_channel_win32_new_fd(fd);
+#else
+  p->channel = g_io_channel_unix_new(fd);
+#endif
+  /* output is passed on as raw bytes, it is converted once complete */
+  g_io_channel_set_encoding(p->channel, NULL, NULL);
+  g_io_channel_set_buffered(p->channel, FALSE);
+  g_io_channel_set_close_on_unref(p->channel, TRUE);
+  p->listeners = NULL;
+  p->exit_func = NULL;
+  p->exit_data = NULL;
+  p->eof = FALSE;
+  p->exited = FALSE;
+
+  return p;
+}
+
+void process_add_listener(GuProcess* proc, GuProcessOutputFunc func,
+                          gpointer user)
+{
+  Tuple2* listener = g_new0(Tuple2, 1);
+  listener->first = (gpointer)func;
+  listener->second = user;
+  proc->listeners = g_slist_append(proc->listeners, listener);
+}
+
+gint process_wait(GuProcess* proc)
+{
+  gchar buf[BUFSIZ];
+  gsize len = 0;
+  gboolean watched = FALSE;
+
+#ifndef WIN32
+  if ((watched = proc->wall_limit > 0 || proc->cpu_limit > 0))
+    process_read_watched(proc);
+#endif
+  while (!watched &&
+         g_io_channel_read_chars(proc->channel, buf, BUFSIZ, &len, NULL)
+         == G_IO_STATUS_NORMAL) {
+    process_append(proc, buf, len);
+  }
+  process_close_channel(proc);
+
+#ifdef WIN32 // TODO: check this
+  proc->status = WaitForSingleObject(proc->pid, INFINITE);
+#else
+  /* the zombie holds on to the id of the group until it is reaped */
+  siginfo_t info;
+  waitid(P_PID, proc->pid, &info, WEXITED | WNOWAIT);
+  process_forget(proc->pid);
+  waitpid(proc->pid, &proc->status, 0);
+#endif
+  proc->exited = TRUE;
+
+  return proc->status;
+}
+
+#ifndef WIN32
+static void process_read_watched(GuProcess* proc)
+{
+  gchar buf[BUFSIZ];
+  gsize len = 0;
+  GIOStatus status = G_IO_STATUS_NORMAL;
+  GPollFD fd = { g_io_channel_unix_get_fd(proc->channel),
+                 G_IO_IN | G_IO_HUP | G_IO_ERR, 0 };
+  gint64 start = g_get_monotonic_time();
+
+  g_io_channel_set_flags(proc->channel, G_IO_FLAG_NONBLOCK, NULL);
+  while (TRUE) {
+    g_poll(&fd, 1, PROCESS_WATCH_INTERVAL);
+    while ((status = g_io_channel_read_chars(proc->channel, buf, BUFSIZ,
+                                             &len, NULL))
+           == G_IO_STATUS_NORMAL && len) {
+      process_append(proc, buf, len);
+    }
+    if (status != G_IO_STATUS_AGAIN) break;
+    if (proc->timed_out) continue;
+
+    /* An endless loop in a document keeps TeX busy for good, without
+     * ever writing anything that would tell */
+    gdouble elapsed = (gdouble)(g_get_monotonic_time() - start)
+                      / G_USEC_PER_SEC;
+    gdouble cpu = proc->cpu_limit > 0 ? process_get_cpu_time(proc->pid) : 0;
+    if ((proc->wall_limit > 0 && elapsed > proc->wall_limit) ||
+        (proc->cpu_limit > 0 && cpu > proc->cpu_limit)) {
+      gchar* note = g_strdup_printf("\n! Gummi: aborted after %.0fs "
+                                    "(%.0fs of CPU time).\n", elapsed, cpu);
+      slog(L_WARNING, "Process %d exceeded its limits, terminating\n",
+           proc->pid);
+      process_append(proc, note, strlen(note));
+      g_free(note);
+      proc->timed_out = TRUE;
+      process_terminate(proc->pid);
+    }
+  }
+}
+
+static gdouble process_get_cpu_time(GPid pid)
+{
+  gchar* path = g_strdup_printf("/proc/%d/stat", pid);
+  gchar* contents = NULL;
+  gchar* fields = NULL;
+  gulong utime = 0, stime = 0;
+  glong cutime = 0, cstime = 0;
+  gdouble seconds = 0;
+
+  /* user and system time of the process and of the children it reaped,
+   * right after the parenthesized command name, state and 10 numbers */
+  if (g_file_get_contents(path, &contents, NULL, NULL) &&
+      (fields = strrchr(contents, ')')) &&
+      sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+             "%lu %lu %ld %ld", &utime, &stime, &cutime, &cstime) == 4) {
+    seconds = (gdouble)(utime + stime + cutime + cstime)
+              / sysconf(_SC_CLK_TCK);
+  }
+  g_free(contents);
+  g_free(path);
+  return seconds;
+}
+#endif
+
+void process_watch(GuProcess* proc, GuProcessExitFunc func, gpointer user)
+{
+  proc->exit_func = func;
+  proc->exit_data = user;
+
+  g_io_channel_set_flags(proc->channel, G_IO_FLAG_NONBLOCK, NULL);
+  g_io_add_watch(proc->channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                 process_on_output, proc);
+  g_child_watch_add(proc->pid, process_on_exit, proc);
+}
+
+gchar* process_steal_output(GuProcess* proc)
+{
+  gchar* ret = NULL;
+
+  if (!proc->output->len) return NULL;
+
+  ret = g_string_free(proc->output, FALSE);
+  proc->output = g_string_new("");
+
+  // See bug 446:
+  if (!g_utf8_validate(ret, -1, NULL)) {
+    gchar* converted = g_convert_with_fallback(ret, -1, "UTF-8",
+                                               "ISO-8859-1", NULL, NULL,
+                                               NULL, NULL);
+    g_free(ret);
+    ret = converted;
+  }
+  return ret;
+}
+
+void process_free(GuProcess* proc)
+{
+  GSList* iter = NULL;
+
+  if (!proc) return;
+  process_close_channel(proc);
+  for (iter = proc->listeners; iter; iter = iter->next)
+    g_free(iter->data);
+  g_slist_free(proc->listeners);
+  g_string_free(proc->output, TRUE);
+  g_free(proc);
+}
+
+static void process_append(GuProcess* proc, const gchar* data, gsize len)
+{
+  GSList* iter = NULL;
+
+  if (!len) return;
+  /* appending keeps the capture linear in the size of the output */
+  g_string_append_len(proc->output, data, len);
+  for (iter = proc->listeners; iter; iter = iter->next) {
+    Tuple2* listener = TUPLE2(iter->data);
+    ((GuProcessOutputFunc)listener->first)(data, len, listener->second);
+  }
+}
+
+static void process_close_channel(GuProcess* proc)
+{
+  if (!proc->channel) return;
+  g_io_channel_shutdown(proc->channel, FALSE, NULL);
+  g_io_channel_unref(proc->channel);
+  proc->channel = NULL;
+}
+
+static gboolean process_on_output(GIOChannel* channel, GIOCondition cond,
+                                  gpointer user)
+{
+  GuProcess* proc = GU_PROCESS(user);
+  gchar buf[BUFSIZ];
+  gsize len = 0;
+  GIOStatus status = G_IO_STATUS_NORMAL;
+
+  while ((status = g_io_channel_read_chars(channel, buf, BUFSIZ, &len, NULL))
+         == G_IO_STATUS_NORMAL && len) {
+    process_append(proc, buf, len);
+  }
+  if (status == G_IO_STATUS_AGAIN) return TRUE;
+
+  process_close_channel(proc);
+  proc->eof = TRUE;
+  process_check_finished(proc);
+  return FALSE;
+}
+
+static void process_on_exit(GPid pid, gint status, gpointer user)
+{
+  GuProcess* proc = GU_PROCESS(user);
+
+  process_forget(pid);
+  proc->status = status;
+  proc->exited = TRUE;
+  g_spawn_close_pid(pid);
+  process_check_finished(proc);
+}
+
+static void process_check_finished(GuProcess* proc)
+{
+  gchar* output = NULL;
+
+  if (!proc->eof || !proc->exited) return;
+
+  output = process_steal_output(proc);
+  if (proc->exit_func)
+    proc->exit_func(proc->status, output, proc->exit_data);
+  g_free(output);
+  process_free(proc);
+}
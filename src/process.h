@@ -0,0 +1,189 @@
+/**
+ * @file   process.h
+ * @brief  subprocess output capture
+ *
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GUMMI_PROCESS_H__
+#define __GUMMI_PROCESS_H__
+
+#include <glib.h>
+
+/**
+ * GuProcessOutputFunc:
+ *
+ * Called with every chunk of output as soon as it was read.
+ */
+typedef void (*GuProcessOutputFunc)(const gchar* data, gsize len,
+                                    gpointer user);
+
+/**
+ * GuProcessExitFunc:
+ *
+ * Called from the main loop once the process exited and all its output was
+ * read. The process is freed after the callback returns.
+ */
+typedef void (*GuProcessExitFunc)(gint status, const gchar* output,
+                                  gpointer user);
+
+/**
+ * GuProcess:
+ * @pid: process id of the child
+ * @output: everything the child wrote to its stdout so far
+ * @status: exit status as returned by waitpid, valid once it exited
+ * @wall_limit: seconds process_wait lets the process run, or 0
+ * @cpu_limit: seconds of CPU time process_wait lets the process use, or 0
+ * @timed_out: TRUE if process_wait terminated the process over a limit
+ *
+ * A spawned child process whose stdout is captured into a growable buffer.
+ * The output can be collected either by blocking on process_wait or from
+ * the main loop by process_watch. Children are spawned as leaders of their
+ * own process group, so whatever they start in turn can be terminated
+ * along with them.
+ */
+#define GU_PROCESS(x) ((GuProcess*)x)
+typedef struct _GuProcess GuProcess;
+
+struct _GuProcess {
+  GPid pid;
+  GString* output;
+  gint status;
+  gint wall_limit;
+  gint cpu_limit;
+  gboolean timed_out;
+
+  /*< private >*/
+  GIOChannel* channel;
+  GSList* listeners;
+  GuProcessExitFunc exit_func;
+  gpointer exit_data;
+  gboolean eof;
+  gboolean exited;
+};
+
+/**
+ * GuSpawnPolicy:
+ * @niceness: niceness the child adds to its own
+ * @ioclass: I/O scheduling class of the child as taken by ionice, 2 or 3,
+ *           or 0 to leave it alone
+ *
+ * How a child is to be scheduled. It is filled in before spawning from the
+ * configuration, which the child can no longer safely read. Only compiles
+ * are scheduled this way, the helpers Gummi runs are not.
+ */
+typedef struct _GuSpawnPolicy GuSpawnPolicy;
+
+struct _GuSpawnPolicy {
+  gint niceness;
+  gint ioclass;
+};
+
+GuProcess* process_spawn(const gchar* cmd, const gchar* chdir, GError** err);
+
+/**
+ * process_spawn_full:
+ *
+ * Like process_spawn, but the child is scheduled by policy, which may be
+ * NULL.
+ */
+GuProcess* process_spawn_full(const gchar* cmd, const gchar* chdir,
+                              GuSpawnPolicy* policy, GError** err);
+void process_get_policy(GuSpawnPolicy* policy);
+
+/**
+ * process_setup_child:
+ *
+ * Child setup function for g_spawn_* that makes the child the leader of a
+ * new session and process group. user is a GuSpawnPolicy to apply or NULL.
+ */
+void process_setup_child(gpointer user);
+
+/**
+ * process_wrap_command:
+ *
+ * Returns: A newly allocated command that runs cmd in a transient cgroup
+ * scope with the configured CPU weight and memory limit, or a copy of cmd
+ * if that is disabled or not available.
+ */
+gchar* process_wrap_command(const gchar* cmd);
+
+/**
+ * process_terminate:
+ *
+ * Sends SIGTERM to the process group led by pid and SIGKILL to whatever
+ * is left of it shortly after. The escalation runs from the main loop and
+ * is dropped once pid is reaped.
+ */
+void process_terminate(GPid pid);
+
+/**
+ * process_forget:
+ *
+ * Drops the pending SIGKILL of process_terminate for pid. Whoever reaps a
+ * child outside of process_wait and process_watch calls it beforehand.
+ */
+void process_forget(GPid pid);
+
+/**
+ * process_new:
+ *
+ * Adopts a child that was already spawned with G_SPAWN_DO_NOT_REAP_CHILD,
+ * fd is its stdout and owned by the returned process.
+ */
+GuProcess* process_new(GPid pid, gint fd);
+void process_add_listener(GuProcess* proc, GuProcessOutputFunc func,
+                          gpointer user);
+
+/**
+ * process_wait:
+ *
+ * Returns: the exit status of the process
+ *
+ * Reads all output of the process and waits for it to exit. Listeners are
+ * invoked from the calling thread. A process that exceeds wall_limit or
+ * cpu_limit is terminated, a note about it is added to its output.
+ */
+gint process_wait(GuProcess* proc);
+
+/**
+ * process_watch:
+ *
+ * Collects output and the exit status from the main loop without blocking
+ * and reports them to func. Ownership of proc passes to the watch.
+ */
+void process_watch(GuProcess* proc, GuProcessExitFunc func, gpointer user);
+
+/**
+ * process_steal_output:
+ *
+ * Returns: The newly allocated output converted to UTF-8, or NULL if the
+ * process didn't write anything. The buffer of proc is emptied.
+ */
+gchar* process_steal_output(GuProcess* proc);
+void process_free(GuProcess* proc);
+
+#endif /* __GUMMI_PROCESS_H__ */
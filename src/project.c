@@ -32,6 +32,7 @@
 #include <string.h>
 
 #include "configfile.h"
+#include "editor.h"
 #include "environment.h"
 #include "gui/gui-main.h"
 #include "gui/gui-project.h"
@@ -249,3 +250,46 @@ gchar* project_get_value(const gchar* content, const gchar* item)
   }
   return result;
 }
+
+GuEditor* project_get_root_editor(GuEditor* ec)
+{
+  GList* editors = NULL;
+  GList* iter = NULL;
+  GuEditor* root = NULL;
+
+  /* Only members of the open project are built through its root file */
+  if (!ec || !gummi->project->rootfile || !ec->projfile) return NULL;
+  if (!STR_EQU(ec->projfile, gummi->project->projfile)) return NULL;
+  if (STR_EQU(ec->filename, gummi->project->rootfile)) return NULL;
+
+  editors = gummi_get_all_editors();
+  for (iter = editors; iter; iter = iter->next) {
+    if (STR_EQU(GU_EDITOR(iter->data)->filename, gummi->project->rootfile)) {
+      root = GU_EDITOR(iter->data);
+      break;
+    }
+  }
+  g_list_free(editors);
+  return root;
+}
+
+gchar* project_get_include_name(GuEditor* root, GuEditor* ec)
+{
+  gchar* rootdir = NULL;
+  gchar* name = NULL;
+  gsize len = 0;
+
+  if (!root->filename || !ec->filename) return NULL;
+
+  /* \include takes the path relative to the root file without .tex */
+  rootdir = g_path_get_dirname(root->filename);
+  len = strlen(rootdir);
+  if (g_str_has_prefix(ec->filename, rootdir) &&
+      ec->filename[len] == G_DIR_SEPARATOR) {
+    name = g_strdup(ec->filename + len + 1);
+    if (g_str_has_suffix(name, ".tex"))
+      name[strlen(name) - 4] = 0;
+  }
+  g_free(rootdir);
+  return name;
+}
@@ -55,4 +55,7 @@ gchar* project_get_value(const gchar* content, const gchar* item);
 gboolean project_add_document(const gchar* project, const gchar* fname);
 gboolean project_remove_document(const gchar* project, const gchar* fname);
 
+struct _GuEditor* project_get_root_editor(struct _GuEditor* ec);
+gchar* project_get_include_name(struct _GuEditor* root, struct _GuEditor* ec);
+
 #endif /* __GUMMI_PROJECT_H__ */
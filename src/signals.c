@@ -55,4 +55,16 @@ void gummi_signals_register(void)
                0, NULL, NULL,
                g_cclosure_marshal_VOID__POINTER,
                G_TYPE_NONE, 1, G_TYPE_POINTER);
+
+  g_signal_new("document-focused",
+               G_TYPE_OBJECT, G_SIGNAL_RUN_FIRST,
+               0, NULL, NULL,
+               g_cclosure_marshal_VOID__POINTER,
+               G_TYPE_NONE, 1, G_TYPE_POINTER);
+
+  g_signal_new("document-progress",
+               G_TYPE_OBJECT, G_SIGNAL_RUN_FIRST,
+               0, NULL, NULL,
+               g_cclosure_marshal_VOID__POINTER,
+               G_TYPE_NONE, 1, G_TYPE_POINTER);
 }
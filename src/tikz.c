@@ -0,0 +1,311 @@
+/**
+ * @file   tikz.c
+ * @brief  externalization of TikZ pictures
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "tikz.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "configfile.h"
+#include "constants.h"
+#include "external.h"
+#include "latex.h"
+#include "utils.h"
+
+#include "compile/texlive.h"
+
+#define BEGIN_PICTURE "\\begin{tikzpicture}"
+#define END_PICTURE "\\end{tikzpicture}"
+#define BEGIN_DOCUMENT "\\begin{document}"
+
+static gboolean tikz_in_comment(const gchar* text, const gchar* pos);
+static const gchar* tikz_find(const gchar* text, const gchar* from,
+                              const gchar* marker);
+static void tikz_hash_data_files(GChecksum* checksum, GRegex* files,
+                                 const gchar* curdir, const gchar* start,
+                                 const gchar* end);
+static gchar* tikz_get_setup(GuTikz* tc);
+
+GuTikz* tikz_init(void)
+{
+  GuTikz* t = g_new0(GuTikz, 1);
+
+  t->dir = NULL;
+  t->source = NULL;
+  t->sourcehash = NULL;
+  t->figures = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  t->built = 0;
+
+  return t;
+}
+
+gboolean tikz_active(const gchar* text)
+{
+  if (!config_get_value("tikz_external")) return FALSE;
+
+  /* figures are built with make, or by TeX itself through shell escape */
+  if (!external_exists("make") && !latex_use_shellescaping()) return FALSE;
+  return utils_subinstr("\\usepackage{tikz}", (gchar*)text, FALSE) ||
+         utils_subinstr("\\usepackage{pgfplots}", (gchar*)text, FALSE);
+}
+
+static gboolean tikz_in_comment(const gchar* text, const gchar* pos)
+{
+  const gchar* line = pos;
+
+  while (line > text && *(line - 1) != '\n') --line;
+  for (; line < pos; ++line) {
+    if (*line == '%' && (line == text || *(line - 1) != '\\')) return TRUE;
+  }
+  return FALSE;
+}
+
+static const gchar* tikz_find(const gchar* text, const gchar* from,
+                              const gchar* marker)
+{
+  const gchar* pos = NULL;
+
+  for (pos = strstr(from, marker); pos && tikz_in_comment(text, pos);
+       pos = strstr(pos + 1, marker));
+  return pos;
+}
+
+static void tikz_hash_data_files(GChecksum* checksum, GRegex* files,
+                                 const gchar* curdir, const gchar* start,
+                                 const gchar* end)
+{
+  GMatchInfo* match_info = NULL;
+  gchar* body = g_strndup(start, end - start);
+  gchar* file = NULL;
+  gchar* path = NULL;
+  gchar* stamp = NULL;
+  GStatBuf st;
+
+  /* Tables, plotted data and images are read while the figure is built,
+   * a changed file gives the figure a new name */
+  g_regex_match(files, body, 0, &match_info);
+  while (g_match_info_matches(match_info)) {
+    file = g_match_info_fetch(match_info, 1);
+    path = g_path_is_absolute(file) ? g_strdup(file)
+                                    : g_build_filename(curdir, file, NULL);
+    if (g_stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+      stamp = g_strdup_printf("%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                              path, (gint64)st.st_mtime, (gint64)st.st_size);
+      g_checksum_update(checksum, (guchar*)stamp, -1);
+      g_free(stamp);
+    }
+    g_free(path);
+    g_free(file);
+    g_match_info_next(match_info, NULL);
+  }
+  g_match_info_free(match_info);
+  g_free(body);
+}
+
+static gchar* tikz_get_setup(GuTikz* tc)
+{
+  const gchar* typesetter = pdflatex_active() ? C_PDFLATEX : C_XELATEX;
+  gboolean make = external_exists("make");
+
+  /* The figures are typeset from the copy of the document without the
+   * draft switch, which is not what TeX would derive from the job name.
+   * Everything stays on one line */
+  return g_strdup_printf("\\usetikzlibrary{external}"
+                         "\\tikzexternalize[prefix={%s%c},"
+                         "mode={%s}]"
+                         "\\tikzset{external/system call={%s "
+                         "-halt-on-error -interaction=batchmode "
+                         "-jobname \"\\image\" \"\\string\\def"
+                         "\\string\\tikzexternalrealjob{\\pgfactualjobname}"
+                         "\\string\\input{%s}\"}}",
+                         tc->dir, G_DIR_SEPARATOR,
+                         make ? "list and make" : "convert with system call",
+                         typesetter, tc->source);
+}
+
+gchar* tikz_prepare(GuTikz* tc, GuEditor* ec, const gchar* text,
+                    gboolean proxies)
+{
+  const gchar* begin = strstr(text, BEGIN_DOCUMENT);
+  const gchar* typesetter = pdflatex_active() ? C_PDFLATEX : C_XELATEX;
+  const gchar* pos = NULL;
+  const gchar* end = NULL;
+  const gchar* last = text;
+  GChecksum* checksum = NULL;
+  GRegex* files = NULL;
+  GString* result = NULL;
+  gchar* preamblehash = NULL;
+  gchar* sourcehash = NULL;
+  gchar* curdir = NULL;
+  gchar* setup = NULL;
+  gchar* name = NULL;
+  gchar* id = NULL;
+  gchar* ret = NULL;
+
+  if (!begin) return g_strdup(text);
+
+  /* one directory per document, it outlives the session */
+  id = g_compute_checksum_for_string(G_CHECKSUM_MD5,
+      ec->filename ? ec->filename : ec->fdname, -1);
+  g_free(tc->dir);
+  tc->dir = g_build_filename(g_get_user_cache_dir(), "gummi", "tikz", id,
+                             NULL);
+  g_mkdir_with_parents(tc->dir, DIR_PERMS);
+  g_free(tc->source);
+  tc->source = g_build_filename(tc->dir, "figures.tex", NULL);
+  g_free(id);
+  g_hash_table_remove_all(tc->figures);
+
+  setup = tikz_get_setup(tc);
+  result = g_string_sized_new(strlen(text) + strlen(setup) + 256);
+  g_string_append_len(result, text, begin - text);
+  g_string_append(result, setup);
+  last = begin;
+
+  /* Anything in the preamble can change what a figure looks like, so can
+   * the typesetter and the proxies found in place of the images */
+  preamblehash = g_compute_checksum_for_data(G_CHECKSUM_MD5,
+                                             (guchar*)text, begin - text);
+  files = g_regex_new("\\{\\s*([^{}\\s]+\\.[A-Za-z0-9]+)\\s*\\}", 0, 0,
+                      NULL);
+  curdir = editor_get_compile_dir(ec);
+
+  for (pos = tikz_find(text, begin, BEGIN_PICTURE); pos;
+       pos = tikz_find(text, pos + 1, BEGIN_PICTURE)) {
+    if (!(end = tikz_find(text, pos, END_PICTURE))) break;
+
+    checksum = g_checksum_new(G_CHECKSUM_MD5);
+    g_checksum_update(checksum, (guchar*)preamblehash, -1);
+    g_checksum_update(checksum, (guchar*)typesetter, -1);
+    g_checksum_update(checksum, (guchar*)(proxies ? "proxies" : "images"),
+                      -1);
+    g_checksum_update(checksum, (guchar*)pos, end - pos);
+    if (files) tikz_hash_data_files(checksum, files, curdir, pos, end);
+    name = g_strdup_printf("fig-%.16s", g_checksum_get_string(checksum));
+    g_checksum_free(checksum);
+
+    g_string_append_len(result, last, pos - last);
+    g_string_append_printf(result, "\\tikzsetnextfilename{%s}", name);
+    last = pos;
+    g_hash_table_insert(tc->figures, name, NULL);
+  }
+  g_string_append(result, last);
+  ret = g_string_free(result, FALSE);
+
+  /* The figures \input this copy, the workfile may get the draft switch
+   * added. Rewritten only on changes, like the workfile */
+  sourcehash = g_compute_checksum_for_string(G_CHECKSUM_MD5, ret, -1);
+  if (!STR_EQU(sourcehash, tc->sourcehash) ||
+      !utils_path_exists(tc->source)) {
+    utils_set_file_contents(tc->source, ret, -1);
+  }
+  g_free(tc->sourcehash);
+  tc->sourcehash = sourcehash;
+
+  slog(L_DEBUG, "Externalizing %u TikZ figures\n",
+       g_hash_table_size(tc->figures));
+  if (files) g_regex_unref(files);
+  g_free(preamblehash);
+  g_free(curdir);
+  g_free(setup);
+  return ret;
+}
+
+gboolean tikz_build_figures(GuTikz* tc, GuEditor* ec, const gchar* curdir)
+{
+  GHashTableIter iter;
+  gpointer name = NULL;
+  guint missing = 0;
+  gchar* makefile = NULL;
+  gchar* command = NULL;
+  gchar* pdf = NULL;
+  gint jobs = 0;
+  Tuple2 res;
+
+  tc->built = 0;
+  if (!tc->dir || !external_exists("make")) return FALSE;
+
+  g_hash_table_iter_init(&iter, tc->figures);
+  while (g_hash_table_iter_next(&iter, &name, NULL)) {
+    pdf = g_strdup_printf("%s%c%s.pdf", tc->dir, G_DIR_SEPARATOR,
+                          (gchar*)name);
+    if (!utils_path_exists(pdf)) missing++;
+    g_free(pdf);
+  }
+  if (!missing) return FALSE;
+
+  /* TeX listed the figures to build in a makefile next to its output */
+  makefile = g_strdup_printf("%.*s.makefile", (gint)strlen(ec->pdffile) - 4,
+                             ec->pdffile);
+  jobs = atoi(config_get_value("tikz_jobs"));
+  if (jobs <= 0) jobs = g_get_num_processors();
+  command = g_strdup_printf("%s make -j %d -f \"%s\"", C_TEXSEC, jobs,
+                            makefile);
+
+  slog(L_DEBUG, "Building %u TikZ figures with %d jobs\n", missing, jobs);
+  res = utils_popen_r(command, curdir);
+  if ((glong)res.first != 0)
+    slog(L_WARNING, "Could not build all TikZ figures:\n%s\n",
+         res.second ? (gchar*)res.second : "");
+  else
+    tc->built = missing;
+
+  g_free(res.second);
+  g_free(command);
+  g_free(makefile);
+  return tc->built > 0;
+}
+
+void tikz_prune(GuTikz* tc)
+{
+  GDir* dir = NULL;
+  const gchar* file = NULL;
+  const gchar* ext = NULL;
+  gchar* name = NULL;
+  gchar* path = NULL;
+
+  if (!tc->dir || !(dir = g_dir_open(tc->dir, 0, NULL))) return;
+
+  /* every figure leaves a .pdf, .log, .dpth and .md5 behind */
+  while ((file = g_dir_read_name(dir))) {
+    ext = strrchr(file, '.');
+    name = ext ? g_strndup(file, ext - file) : g_strdup(file);
+    if (g_str_has_prefix(name, "fig-") &&
+        !g_hash_table_contains(tc->figures, name)) {
+      path = g_build_filename(tc->dir, file, NULL);
+      g_remove(path);
+      g_free(path);
+    }
+    g_free(name);
+  }
+  g_dir_close(dir);
+}
@@ -0,0 +1,100 @@
+/**
+ * @file   tikz.h
+ * @brief  externalization of TikZ pictures
+ *
+ * Copyright (C) 2009-2012 Gummi-Dev Team <alexvandermey@gmail.com>
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GUMMI_TIKZ_H__
+#define __GUMMI_TIKZ_H__
+
+#include <glib.h>
+
+#include "editor.h"
+
+/**
+ * GuTikz:
+ * @dir: figure directory of the document last prepared
+ * @source: copy of that document the figures are typeset from
+ * @sourcehash: checksum of @source
+ * @figures: names of the figures of the document last prepared
+ * @built: number of figures built by the last tikz_build_figures
+ *
+ * Every tikzpicture is externalized under a name derived from its source,
+ * the preamble, the typesetter, whether image proxies are in use and the
+ * data files it reads, so figures that did not change keep their file no
+ * matter where they moved in the document, and only changed figures are
+ * typeset again. The figures live in a per-document directory under the
+ * user cache directory and are built in parallel with make.
+ */
+#define GU_TIKZ(x) ((GuTikz*)x)
+typedef struct _GuTikz GuTikz;
+
+struct _GuTikz {
+  gchar* dir;
+  gchar* source;
+  gchar* sourcehash;
+  GHashTable* figures;
+  guint built;
+};
+
+GuTikz* tikz_init(void);
+
+/**
+ * tikz_active:
+ *
+ * Returns: TRUE if externalization is enabled and text uses TikZ.
+ */
+gboolean tikz_active(const gchar* text);
+
+/**
+ * tikz_prepare:
+ *
+ * Returns: A newly allocated copy of text with the externalization set up
+ * in front of \begin{document} and every tikzpicture named. Line numbers
+ * are kept. The figures are typeset from a copy of the result that is
+ * written to @source, so nothing added to the workfile afterwards, the
+ * draft switch in particular, reaches them.
+ */
+gchar* tikz_prepare(GuTikz* tc, GuEditor* ec, const gchar* text,
+                    gboolean proxies);
+
+/**
+ * tikz_build_figures:
+ *
+ * Builds the figures the last compile of ec found missing.
+ *
+ * Returns: TRUE if figures were built and the document needs another pass.
+ */
+gboolean tikz_build_figures(GuTikz* tc, GuEditor* ec, const gchar* curdir);
+
+/**
+ * tikz_prune:
+ *
+ * Removes figures of the document that are no longer used.
+ */
+void tikz_prune(GuTikz* tc);
+
+#endif /* __GUMMI_TIKZ_H__ */
@@ -49,6 +49,7 @@
 #   define WEXITSTATUS(stat_val) ((unsigned int) (stat_val) >> 8)
 #endif
 
+#include "configfile.h"
 #include "constants.h"
 #include "environment.h"
 #include "utils.h"
@@ -75,6 +76,10 @@ static GtkWindow* parent = 0;
 GThread* main_thread = 0;
 extern pid_t typesetter_pid;
 
+static GuProcess* utils_popen_spawn(const gchar* cmd, const gchar* chdir,
+                                    GuSpawnPolicy* policy);
+static Tuple2 utils_popen_finish(GuProcess* proc, gboolean watchdog);
+
 
 void slog_init(gint debug)
 {
@@ -225,60 +230,61 @@ gboolean utils_copy_file(const gchar* source, const gchar* dest,
 
 Tuple2 utils_popen_r(const gchar* cmd, const gchar* chdir)
 {
-  gchar buf[BUFSIZ];
-  int pout = 0;
-  gchar* ret = NULL;
-  gchar* rot = NULL;
-  glong len = 0;
-  gint status = 0;
-  int n_args = 0;
-  gchar** args = NULL;
-  GError* error = NULL;
+  return utils_popen_finish(utils_popen_spawn(cmd, chdir, NULL), FALSE);
+}
 
-  g_assert(cmd != NULL);
+Tuple2 utils_popen_r_full(const gchar* cmd, const gchar* chdir,
+                          GuProcessOutputFunc func, gpointer user)
+{
+  /* the typesetter runs in its own cgroup scope and at the configured
+   * priority */
+  GuSpawnPolicy policy;
+  gchar* wrapped = process_wrap_command(cmd);
 
-  /* XXX: Set process pid, ugly... */
-  if (!g_shell_parse_argv(cmd, &n_args, &args, &error)) {
-    slog(L_G_FATAL, "%s", error->message);
-    /* Not reached */
-  }
+  process_get_policy(&policy);
+  GuProcess* proc = utils_popen_spawn(wrapped, chdir, &policy);
+
+  g_free(wrapped);
+  if (func) process_add_listener(proc, func, user);
+  return utils_popen_finish(proc, TRUE);
+}
+
+static GuProcess* utils_popen_spawn(const gchar* cmd, const gchar* chdir,
+                                    GuSpawnPolicy* policy)
+{
+  GuProcess* proc = NULL;
+  GError* error = NULL;
 
-  if (!g_spawn_async_with_pipes(chdir, args, NULL,
-                                G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-                                NULL, NULL, &typesetter_pid, NULL, &pout, NULL, &error)) {
+  if (!(proc = process_spawn_full(cmd, chdir, policy, &error))) {
     slog(L_G_FATAL, "%s", error->message);
     /* Not reached */
   }
 
-  // TODO: replace with GIOChannel implementation:
-  while ((len = read(pout, buf, BUFSIZ)) > 0) {
-    buf[len - (len == BUFSIZ)] = 0;
-    rot = g_strdup(ret);
-    g_free(ret);
-    if (ret)
-      ret = g_strconcat(rot, buf, NULL);
-    else
-      ret = g_strdup(buf);
-    g_free(rot);
-  }
+  /* XXX: Set process pid, ugly... */
+  typesetter_pid = proc->pid;
+  return proc;
+}
 
-  // close the file descriptor:
-  close(pout);
+Tuple2 utils_popen_collect(GPid pid, gint pout, GuProcessOutputFunc func,
+                           gpointer user)
+{
+  GuProcess* proc = process_new(pid, pout);
 
-#ifdef WIN32 // TODO: check this
-  status = WaitForSingleObject(typesetter_pid, INFINITE);
-#else
-  waitpid(typesetter_pid, &status, 0);
-#endif
+  if (func) process_add_listener(proc, func, user);
+  return utils_popen_finish(proc, TRUE);
+}
 
-  // See bug 446:
-  if (ret) {
-    if (!g_utf8_validate(ret, -1, NULL)) {
-      ret = g_convert_with_fallback(ret, -1, "UTF-8",
-                                    "ISO-8859-1", NULL, NULL, NULL, NULL);
-    }
+static Tuple2 utils_popen_finish(GuProcess* proc, gboolean watchdog)
+{
+  if (watchdog) {
+    proc->wall_limit = atoi(config_get_value("compile_timeout"));
+    proc->cpu_limit = atoi(config_get_value("compile_cpu_limit"));
   }
 
+  gint status = process_wait(proc);
+  gchar* ret = process_steal_output(proc);
+
+  process_free(proc);
   return (Tuple2) {
     NULL, (gpointer)(glong)status, (gpointer)ret
   };
@@ -302,7 +308,13 @@ gchar* utils_get_tmp_tmp_dir(void)
 #ifdef WIN32
     tmp_tmp = g_build_path(C_DIRSEP, g_get_home_dir(), "gtmp", NULL);
 #else
-    tmp_tmp = g_build_path(C_DIRSEP, g_get_tmp_dir(), "gummi", NULL);
+    /* Keep compile I/O in memory when asked to, a missing key reads as
+     * empty here as the config defaults are not filled in yet */
+    if (STR_EQU(config_get_value("scratch_in_ram"), "True") &&
+        g_access(C_RAMDIR, W_OK) == 0)
+      tmp_tmp = g_build_path(C_DIRSEP, C_RAMDIR, "gummi", NULL);
+    else
+      tmp_tmp = g_build_path(C_DIRSEP, g_get_tmp_dir(), "gummi", NULL);
 #endif
     g_mkdir_with_parents(tmp_tmp, DIR_PERMS);
   }
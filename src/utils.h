@@ -34,6 +34,8 @@
 #include <glib.h>
 #include <gtk/gtk.h>
 
+#include "process.h"
+
 #ifdef WIN32
 #define DIR_PERMS (S_IRWXU)
 #else
@@ -141,6 +143,31 @@ gboolean utils_copy_file(const gchar* source, const gchar* dest,
  */
 Tuple2 utils_popen_r(const gchar* cmd, const gchar* chdir);
 
+/**
+ * utils_popen_r_full:
+ *
+ * Returns: A Tuple2 in the same format as utils_popen_r
+ *
+ * Like utils_popen_r, but func is called with every chunk of output while
+ * the process is still running. Meant for typesetter runs, the process is
+ * scheduled and confined like a compile and terminated when it exceeds
+ * the compile_timeout or compile_cpu_limit.
+ */
+Tuple2 utils_popen_r_full(const gchar* cmd, const gchar* chdir,
+                          GuProcessOutputFunc func, gpointer user);
+
+/**
+ * utils_popen_collect:
+ *
+ * Returns: A Tuple2 in the same format as utils_popen_r
+ *
+ * Reads the output of an already spawned process from pout until the
+ * process closes it and waits for the process to exit. The limits of
+ * utils_popen_r_full apply.
+ */
+Tuple2 utils_popen_collect(GPid pid, gint pout, GuProcessOutputFunc func,
+                           gpointer user);
+
 /**
  * utils_path_to_relative:
  *